@@ -0,0 +1,64 @@
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <harness.hpp>
+#include <iostream>
+#include <iterator>
+#include <luogu3/compile.hpp>
+#include <luogu3/passes.hpp>
+#include <string>
+#include <vector>
+
+auto main(int argc, char* argv[]) -> int {
+  if (argc < 2) {
+    std::cerr << "Usage: " << *argv << " <file> [input]\n";
+    return 2;
+  }
+  auto file = std::ifstream{argv[1]};
+  if (!file) {
+    std::cerr << argv[1] << ": cannot open\n";
+    return 1;
+  }
+  auto source = std::string{std::istreambuf_iterator<char>{file}, {}};
+  auto input = std::filesystem::path{argc > 2 ? argv[2] : "/dev/null"};
+  auto dir = ud2::luogu3::bench::scratch_directory{"dispatches"};
+  auto counts = std::vector<unsigned long long>{};
+  for (auto thread : {false, true}) {
+    auto result = ud2::luogu3::compile(source);
+    if (!result.diags.empty()) {
+      std::cerr << argv[1] << ": " << result.diags.front().message << '\n';
+      return 1;
+    }
+    auto pipeline = ud2::luogu3::preset_pipeline(ud2::luogu3::default_opt_level);
+    auto threading = ud2::luogu3::find_pass("thread-jumps");
+    if (!thread)
+      std::erase(pipeline, threading);
+    auto state = ud2::luogu3::pass_state{result.prog};
+    auto threaded = static_cast<std::size_t>(0);
+    for (const auto& r : ud2::luogu3::run_pipeline(state, pipeline))
+      if (r.p == threading)
+        threaded = r.result.count;
+    auto options = ud2::luogu3::emit_options{};
+    options.count_dispatches = true;
+    options.origin = state.origin;
+    options.hints = state.hints;
+    options.idioms = state.idioms;
+    auto name = std::string{thread ? "threaded" : "plain"};
+    auto log = dir.path() / (name + ".log");
+    if (!dir.build(name, "", [&](std::ostream& out) { result.prog.emit_c(out, options); }))
+      return 1;
+    if (std::system(((dir.path() / name).string() + " < " + input.string() + " > /dev/null 2> " + log.string()).c_str())) {
+      std::cerr << "emitted program did not terminate normally: " << name << '\n';
+      return 1;
+    }
+    auto text = std::string{};
+    std::getline(std::ifstream{log}, text);
+    counts.push_back(std::strtoull(text.c_str() + text.find(' ') + 1, nullptr, 10));
+    std::cout << name << ": " << counts.back() << " dispatches";
+    if (thread)
+      std::cout << ", " << threaded << " jumps threaded";
+    std::cout << '\n';
+  }
+  std::cout << "avoided: " << (counts[0] - counts[1]) << '\n';
+  return 0;
+}
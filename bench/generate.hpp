@@ -0,0 +1,50 @@
+#ifndef LUOGU3_BENCH_GENERATE_HPP
+#define LUOGU3_BENCH_GENERATE_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+
+namespace ud2::luogu3::bench {
+  inline auto generate_source(std::size_t n, std::uint_least64_t seed = 0) -> std::string {
+    static constexpr auto unary = std::array{"POP", "T00", "T01", "T02", "T03", "T04", "T05"};
+    static constexpr auto binary = std::array{"MOV", "CPY", "T06", "T07", "T08", "T09", "T10", "T11", "T12", "T14", "T15", "T16", "T17", "T18"};
+    static constexpr auto ternary = std::array{"ADD", "SUB", "MUL", "DIV", "MOD", "T19", "T20", "T21"};
+    auto gen = std::mt19937_64{seed};
+    auto pick = [&](std::size_t m) { return static_cast<std::size_t>(gen() % m); };
+    auto stack = [&] { return static_cast<char>('A' + pick(3)); };
+    auto state = [&] { return std::to_string(pick(n) + 1); };
+    auto out = std::to_string(n) + " 1\n";
+    for (auto i = static_cast<std::size_t>(0); i < n; ++i) {
+      switch (pick(8)) {
+        case 0:
+          out += "TER\n";
+          break;
+        case 1:
+          out += std::string{"PUS "} + stack() + ' ' + std::to_string(pick(998244353)) + ' ' + state() + '\n';
+          break;
+        case 2:
+          out += std::string{unary[pick(unary.size())]} + ' ' + stack() + ' ' + state() + '\n';
+          break;
+        case 3:
+        case 4:
+          out += std::string{binary[pick(binary.size())]} + ' ' + stack() + ' ' + stack() + ' ' + state() + '\n';
+          break;
+        case 5:
+          out += std::string{ternary[pick(ternary.size())]} + ' ' + stack() + ' ' + stack() + ' ' + stack() + ' ' + state() + '\n';
+          break;
+        case 6:
+          out += std::string{"EMP "} + stack() + ' ' + state() + ' ' + state() + '\n';
+          break;
+        default:
+          out += std::string{"CMP "} + stack() + ' ' + stack() + ' ' + state() + ' ' + state() + '\n';
+          break;
+      }
+    }
+    return out;
+  }
+}
+
+#endif
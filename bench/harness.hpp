@@ -0,0 +1,144 @@
+#ifndef LUOGU3_BENCH_HARNESS_HPP
+#define LUOGU3_BENCH_HARNESS_HPP
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <luogu3/program.hpp>
+#include <ostream>
+#include <string>
+#include <system_error>
+#include <unistd.h>
+
+namespace ud2::luogu3::bench {
+  inline auto compiler() -> std::string {
+    auto cc = std::getenv("CC");
+    return cc ? cc : "cc";
+  }
+
+  inline auto compiler_flags(const char* fallback) -> std::string {
+    auto flags = std::getenv("CFLAGS");
+    return flags ? flags : fallback;
+  }
+
+  // A temporary directory for emitted C programs, removed on destruction
+  // unless one of them failed to compile.
+  class scratch_directory {
+    std::filesystem::path dir;
+    bool keep = false;
+
+  public:
+    explicit scratch_directory(const std::string& name) : dir{std::filesystem::temp_directory_path() / ("luogu3-" + name + "-" + std::to_string(getpid()))} {
+      std::filesystem::create_directories(this->dir);
+    }
+
+    scratch_directory(const scratch_directory&) = delete;
+    auto operator=(const scratch_directory&) -> scratch_directory& = delete;
+
+    ~scratch_directory() {
+      auto ec = std::error_code{};
+      if (!this->keep)
+        std::filesystem::remove_all(this->dir, ec);
+    }
+
+    auto path() const -> const std::filesystem::path& {
+      return this->dir;
+    }
+
+    // Writes name.c with emit and compiles it with $CC and flags to name.
+    template <class F>
+    auto build(const std::string& name, const std::string& flags, F emit) -> bool {
+      auto c = this->dir / (name + ".c");
+      {
+        auto out = std::ofstream{c};
+        emit(out);
+      }
+      if (std::system((compiler() + ' ' + flags + " -o " + (this->dir / name).string() + ' ' + c.string()).c_str())) {
+        std::cerr << "failed to compile " << c.string() << '\n';
+        this->keep = true;
+        return false;
+      }
+      return true;
+    }
+  };
+
+  // Emits the start of a kernel benchmark: the includes and the helpers
+  // shared by every harness, to be followed by the runtime kernels under
+  // test. fill_random writes pseudo-random values in [lo, hi), time_in_place
+  // returns the mean time of a kernel on a fresh copy of the data, and
+  // compare times a kernel and its reference, checks that they leave the
+  // same data and prints their throughput.
+  inline auto emit_harness_prologue(std::ostream& out) -> void {
+    out
+      << "#include <inttypes.h>\n"
+      << "#include <stdio.h>\n"
+      << "#include <stdlib.h>\n"
+      << "#include <string.h>\n"
+      << "#include <time.h>\n"
+      << "\n"
+      << "#define P UINT64_C(" << modulo << ")\n"
+      << "\n"
+      << "typedef void (*kernel_fn)(uint_least32_t*, uint_least32_t);\n"
+      << "\n"
+      << "static void fill_random(uint_least32_t* ptr, uint_least32_t k, uint_least32_t lo, uint_least32_t hi) {\n"
+      << "  static uint_least64_t seed = 1;\n"
+      << "  for (uint_least32_t i = 0; i < k; ++i) {\n"
+      << "    seed = seed * UINT64_C(6364136223846793005) + 1;\n"
+      << "    ptr[i] = (uint_least32_t) ((seed >> 33) % (hi - lo) + lo);\n"
+      << "  }\n"
+      << "}\n"
+      << "\n"
+      << "static double time_in_place(kernel_fn kernel, const uint_least32_t* data, uint_least32_t* buffer, uint_least32_t k, long rounds) {\n"
+      << "  clock_t total = 0;\n"
+      << "  for (long r = 0; r < rounds; ++r) {\n"
+      << "    memcpy(buffer, data, k * sizeof *data);\n"
+      << "    clock_t start = clock();\n"
+      << "    kernel(buffer, k);\n"
+      << "    total += clock() - start;\n"
+      << "  }\n"
+      << "  return (double) total / CLOCKS_PER_SEC / rounds;\n"
+      << "}\n"
+      << "\n"
+      << "static int check_same(const char* name, const uint_least32_t* a, const uint_least32_t* b, uint_least32_t k) {\n"
+      << "  for (uint_least32_t i = 0; i < k; ++i)\n"
+      << "    if (a[i] != b[i]) {\n"
+      << "      fprintf(stderr, \"%s: results differ at %\" PRIuLEAST32 \"\\n\", name, i);\n"
+      << "      return 0;\n"
+      << "    }\n"
+      << "  return 1;\n"
+      << "}\n"
+      << "\n"
+      << "static int compare(const char* name, kernel_fn kernel, kernel_fn reference, const uint_least32_t* data, uint_least32_t k, long rounds, double bytes) {\n"
+      << "  uint_least32_t* result = malloc(2 * (size_t) k * sizeof *result);\n"
+      << "  double seconds[2];\n"
+      << "  int same;\n"
+      << "  if (!result) {\n"
+      << "    fputs(\"out of memory\\n\", stderr);\n"
+      << "    return 0;\n"
+      << "  }\n"
+      << "  seconds[0] = time_in_place(kernel, data, result, k, rounds);\n"
+      << "  seconds[1] = time_in_place(reference, data, result + k, k, rounds);\n"
+      << "  same = check_same(name, result, result + k, k);\n"
+      << "  free(result);\n"
+      << "  if (same)\n"
+      << "    printf(\"  %s: kernel %.2f GB/s, reference %.2f GB/s, %.2fx\\n\", name, bytes / seconds[0] / 1e9, bytes / seconds[1] / 1e9, seconds[1] / seconds[0]);\n"
+      << "  return same;\n"
+      << "}\n"
+      << "\n";
+  }
+
+  // Compiles the harness written by emit with $CC $CFLAGS (default: -O2
+  // -march=native) and runs it after a line naming the benchmark.
+  template <class F>
+  auto run_harness(const std::string& name, const std::string& title, F emit) -> int {
+    auto flags = compiler_flags("-O2 -march=native");
+    auto dir = scratch_directory{name};
+    if (!dir.build(name, flags, emit))
+      return 1;
+    std::cout << name << ": " << title << ", " << compiler() << ' ' << flags << '\n' << std::flush;
+    return std::system((dir.path() / name).string().c_str()) ? 1 : 0;
+  }
+}
+
+#endif
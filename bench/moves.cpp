@@ -0,0 +1,68 @@
+#include <cstdlib>
+#include <harness.hpp>
+#include <iostream>
+#include <luogu3/program.hpp>
+#include <string>
+
+namespace ud2::luogu3::bench {
+  // Runs the emitted T03 and T06 kernels and straightforward element-by-element
+  // loops on the same pseudo-random values. T06 is timed for a short, a medium
+  // and a long rotation.
+  auto emit_harness(std::ostream& out, std::size_t k, int rounds) -> void {
+    auto kernels = runtime_kernels{};
+    kernels.reverse = true;
+    kernels.rotate = true;
+    emit_harness_prologue(out);
+    emit_runtime(out, k, kernels);
+    out
+      << "#define K " << k << "\n"
+      << "\n"
+      << "static uint_least32_t count;\n"
+      << "static uint_least32_t scratch[K];\n"
+      << "\n"
+      << "static void kernel_rotate(uint_least32_t* ptr, uint_least32_t k) {\n"
+      << "  rotate_segment(ptr, k, count);\n"
+      << "}\n"
+      << "\n"
+      << "static void reference_reverse(uint_least32_t* ptr, uint_least32_t k) {\n"
+      << "  for (uint_least32_t i = 0; i < k / 2; ++i) {\n"
+      << "    uint_least32_t x = ptr[i];\n"
+      << "    ptr[i] = ptr[k - 1 - i];\n"
+      << "    ptr[k - 1 - i] = x;\n"
+      << "  }\n"
+      << "}\n"
+      << "\n"
+      << "static void reference_rotate(uint_least32_t* ptr, uint_least32_t k) {\n"
+      << "  for (uint_least32_t i = 0; i < k; ++i)\n"
+      << "    scratch[(i + count) % k] = ptr[i];\n"
+      << "  for (uint_least32_t i = 0; i < k; ++i)\n"
+      << "    ptr[i] = scratch[i];\n"
+      << "}\n"
+      << "\n"
+      << "static uint_least32_t data[K];\n"
+      << "\n"
+      << "int main(void) {\n"
+      << "  static const char* names[] = {\"T06 rotate by 1\", \"T06 rotate by 100\", \"T06 rotate by k / 3\"};\n"
+      << "  const uint_least32_t counts[] = {1, 100, K / 3};\n"
+      << "  fill_random(data, K, 0, P);\n"
+      << "  if (!compare(\"T03 reverse\", reverse_segment, reference_reverse, data, K, " << rounds << ", K * 8.0))\n"
+      << "    return 1;\n"
+      << "  for (int i = 0; i < 3; ++i) {\n"
+      << "    count = counts[i];\n"
+      << "    if (!compare(names[i], kernel_rotate, reference_rotate, data, K, " << rounds << ", K * 8.0))\n"
+      << "      return 1;\n"
+      << "  }\n"
+      << "  return 0;\n"
+      << "}\n";
+  }
+}
+
+auto main(int argc, char* argv[]) -> int {
+  auto k = argc > 1 ? static_cast<std::size_t>(std::strtoull(argv[1], nullptr, 10)) : 1000000;
+  auto rounds = argc > 2 ? std::atoi(argv[2]) : 50;
+  if (!k || rounds < 1) {
+    std::cerr << "k and rounds must be positive\n";
+    return 2;
+  }
+  return ud2::luogu3::bench::run_harness("moves", std::to_string(k) + " elements, " + std::to_string(rounds) + " rounds", [&](std::ostream& out) { ud2::luogu3::bench::emit_harness(out, k, rounds); });
+}
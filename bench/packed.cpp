@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <generate.hpp>
+#include <iostream>
+#include <luogu3/compile.hpp>
+#include <luogu3/program.hpp>
+#include <ostream>
+#include <sstream>
+#include <streambuf>
+#include <vector>
+
+namespace {
+  class null_buffer : public std::streambuf {
+  protected:
+    auto overflow(int_type c) -> int_type override {
+      return traits_type::not_eof(c);
+    }
+
+    auto xsputn(const char*, std::streamsize n) -> std::streamsize override {
+      return n;
+    }
+  };
+
+  template <class F>
+  auto measure(int rounds, F f) -> double {
+    auto start = std::chrono::steady_clock::now();
+    for (auto i = 0; i < rounds; ++i)
+      f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / rounds;
+  }
+
+  auto in_degrees(const ud2::luogu3::program& prog) -> std::vector<std::uint32_t> {
+    auto result = std::vector<std::uint32_t>(prog.states.size());
+    for (const auto& state : prog.states)
+      std::visit([&](const auto& s) {
+        if constexpr (requires { s.next; })
+          ++result[s.next];
+        if constexpr (requires { s.consequent; }) {
+          ++result[s.consequent];
+          ++result[s.alternative];
+        }
+      }, state);
+    return result;
+  }
+
+  auto in_degrees(const ud2::luogu3::packed_program& packed) -> std::vector<std::uint32_t> {
+    auto result = std::vector<std::uint32_t>(packed.size());
+    for (const auto& successors : packed.successors)
+      for (auto next : successors)
+        if (~next)
+          ++result[next];
+    return result;
+  }
+}
+
+auto main(int argc, char* argv[]) -> int {
+  auto n = argc > 1 ? static_cast<std::size_t>(std::strtoull(argv[1], nullptr, 10)) : ud2::luogu3::max_states;
+  auto rounds = argc > 2 ? std::atoi(argv[2]) : 20;
+  auto options = ud2::luogu3::compile_options{};
+  options.max_states = std::max(options.max_states, n);
+  auto result = ud2::luogu3::compile(ud2::luogu3::bench::generate_source(n), options);
+  if (!result.diags.empty()) {
+    std::cerr << "generated source failed to compile: " << result.diags.front().message << '\n';
+    return 1;
+  }
+  const auto& prog = result.prog;
+  auto packed = ud2::luogu3::pack(prog);
+  auto expected = std::ostringstream{};
+  auto unpacked = std::ostringstream{};
+  auto direct = std::ostringstream{};
+  prog.emit_source(expected);
+  ud2::luogu3::unpack(packed).emit_source(unpacked);
+  packed.emit_source(direct);
+  if (in_degrees(prog) != in_degrees(packed) || expected.str() != unpacked.str() || expected.str() != direct.str()) {
+    std::cerr << "packed program does not round-trip\n";
+    return 1;
+  }
+  auto buffer = null_buffer{};
+  auto out = std::ostream{&buffer};
+  auto sink = static_cast<std::uint32_t>(0);
+  auto variant_bytes = prog.states.size() * sizeof(ud2::luogu3::state);
+  auto packed_bytes = packed.size() * (sizeof(packed.ops[0]) + sizeof(packed.stacks[0]) + sizeof(packed.vals[0]) + sizeof(packed.successors[0]));
+  auto report = [&](const char* name, double variant, double packed) {
+    std::cout << "  " << name << ": " << (variant * 1e3) << " ms variant, " << (packed * 1e3) << " ms packed\n";
+  };
+  std::cout
+    << "packed: " << n << " states, " << rounds << " rounds\n"
+    << "  memory: " << variant_bytes << " bytes variant (" << sizeof(ud2::luogu3::state) << " per state), "
+    << packed_bytes << " bytes packed (" << (packed_bytes / n) << " per state)\n";
+  report("in-degree",
+    measure(rounds, [&] { sink += in_degrees(prog).back(); }),
+    measure(rounds, [&] { sink += in_degrees(packed).back(); }));
+  std::cout
+    << "  pack: " << (measure(rounds, [&] { sink += ud2::luogu3::pack(prog).init; }) * 1e3) << " ms, "
+    << "unpack: " << (measure(rounds, [&] { sink += static_cast<std::uint32_t>(ud2::luogu3::unpack(packed).init); }) * 1e3) << " ms\n";
+  report("emit_source",
+    measure(rounds, [&] { prog.emit_source(out); }),
+    measure(rounds, [&] { packed.emit_source(out); }));
+  report("emit_c",
+    measure(rounds, [&] { prog.emit_c(out); }),
+    measure(rounds, [&] { packed.emit_c(out); }));
+  std::cout << "  checksum: " << sink << '\n';
+  return 0;
+}
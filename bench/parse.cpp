@@ -0,0 +1,30 @@
+#include <chrono>
+#include <cstdlib>
+#include <generate.hpp>
+#include <iostream>
+#include <luogu3/compile.hpp>
+#include <string>
+
+auto main(int argc, char* argv[]) -> int {
+  auto n = argc > 1 ? static_cast<std::size_t>(std::strtoull(argv[1], nullptr, 10)) : ud2::luogu3::max_states;
+  auto rounds = argc > 2 ? std::atoi(argv[2]) : 20;
+  auto options = ud2::luogu3::compile_options{};
+  options.jobs = argc > 3 ? static_cast<std::size_t>(std::strtoull(argv[3], nullptr, 10)) : 1;
+  auto source = ud2::luogu3::bench::generate_source(n);
+  auto states = static_cast<std::size_t>(0);
+  auto start = std::chrono::steady_clock::now();
+  for (auto i = 0; i < rounds; ++i) {
+    auto result = ud2::luogu3::compile(source, options);
+    if (!result.diags.empty()) {
+      std::cerr << "generated source failed to compile: " << result.diags.front().message << '\n';
+      return 1;
+    }
+    states += result.prog.states.size();
+  }
+  auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout
+    << "parse: " << n << " states, " << source.size() << " bytes, " << rounds << " rounds, " << options.jobs << " jobs\n"
+    << "  " << (static_cast<double>(source.size()) * rounds / seconds / 1e6) << " MB/s\n"
+    << "  " << (static_cast<double>(states) / seconds) << " states/s\n";
+  return 0;
+}
@@ -0,0 +1,60 @@
+#include <cstdlib>
+#include <harness.hpp>
+#include <iostream>
+#include <luogu3/program.hpp>
+#include <string>
+
+namespace ud2::luogu3::bench {
+  // Runs the emitted T11 and T12 kernels and straightforward loops that
+  // reduce with % on the same pseudo-random nonzero values below the modulus.
+  // Each stores its result in the first element so that compare can check it.
+  auto emit_harness(std::ostream& out, std::size_t k, int rounds) -> void {
+    auto kernels = runtime_kernels{};
+    kernels.sum = true;
+    kernels.product = true;
+    emit_harness_prologue(out);
+    emit_runtime(out, k, kernels);
+    out
+      << "#define K " << k << "\n"
+      << "\n"
+      << "static void kernel_sum(uint_least32_t* ptr, uint_least32_t k) {\n"
+      << "  ptr[0] = sum_segment(ptr, k);\n"
+      << "}\n"
+      << "\n"
+      << "static void kernel_product(uint_least32_t* ptr, uint_least32_t k) {\n"
+      << "  ptr[0] = product_segment(ptr, k);\n"
+      << "}\n"
+      << "\n"
+      << "static void reference_sum(uint_least32_t* ptr, uint_least32_t k) {\n"
+      << "  uint_least64_t sum = 0;\n"
+      << "  for (uint_least32_t i = 0; i < k; ++i)\n"
+      << "    sum = (sum + ptr[i]) % P;\n"
+      << "  ptr[0] = (uint_least32_t) sum;\n"
+      << "}\n"
+      << "\n"
+      << "static void reference_product(uint_least32_t* ptr, uint_least32_t k) {\n"
+      << "  uint_least64_t product = 1;\n"
+      << "  for (uint_least32_t i = 0; i < k; ++i)\n"
+      << "    product = product * ptr[i] % P;\n"
+      << "  ptr[0] = (uint_least32_t) product;\n"
+      << "}\n"
+      << "\n"
+      << "static uint_least32_t data[K];\n"
+      << "\n"
+      << "int main(void) {\n"
+      << "  fill_random(data, K, 1, P);\n"
+      << "  return !(compare(\"T11 sum\", kernel_sum, reference_sum, data, K, " << rounds << ", K * 4.0)\n"
+      << "    && compare(\"T12 product\", kernel_product, reference_product, data, K, " << rounds << ", K * 4.0));\n"
+      << "}\n";
+  }
+}
+
+auto main(int argc, char* argv[]) -> int {
+  auto k = argc > 1 ? static_cast<std::size_t>(std::strtoull(argv[1], nullptr, 10)) : 1000000;
+  auto rounds = argc > 2 ? std::atoi(argv[2]) : 200;
+  if (!k || rounds < 1) {
+    std::cerr << "k and rounds must be positive\n";
+    return 2;
+  }
+  return ud2::luogu3::bench::run_harness("reductions", std::to_string(k) + " elements, " + std::to_string(rounds) + " rounds", [&](std::ostream& out) { ud2::luogu3::bench::emit_harness(out, k, rounds); });
+}
@@ -0,0 +1,104 @@
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <harness.hpp>
+#include <iostream>
+#include <iterator>
+#include <luogu3/compile.hpp>
+#include <luogu3/passes.hpp>
+#include <string>
+#include <vector>
+
+namespace ud2::luogu3::bench {
+  // A holds the loop counter, B the accumulator and C the constant 1. Each
+  // iteration replaces x on B by x * x + 1 a few times.
+  auto arithmetic_source(std::size_t body) -> std::string {
+    auto lines = std::vector<std::string>{};
+    auto next = [&] { return std::to_string(lines.size() + 2); };
+    lines.push_back("PUS B 1 " + next());
+    lines.push_back("PUS C 1 " + next());
+    auto loop = lines.size() + 1;
+    lines.push_back("");
+    lines.push_back("SUB B A C " + next());
+    lines.push_back("POP A " + next());
+    lines.push_back("MOV A B " + next());
+    for (auto i = static_cast<std::size_t>(0); i < body; ++i) {
+      lines.push_back("MUL C B B " + next());
+      lines.push_back("POP B " + next());
+      lines.push_back("MOV B C " + next());
+      lines.push_back("ADD C B C " + next());
+      lines.push_back("POP B " + next());
+      lines.push_back("MOV B C " + next());
+    }
+    lines.back().replace(lines.back().rfind(' ') + 1, std::string::npos, std::to_string(loop));
+    lines[loop - 1] = "CMP C A " + std::to_string(loop + 1) + ' ' + std::to_string(lines.size() + 1);
+    lines.push_back("POP A " + next());
+    lines.push_back("MOV A B " + next());
+    lines.push_back("TER");
+    auto out = std::to_string(lines.size()) + " 1\n";
+    for (const auto& line : lines)
+      out += line + '\n';
+    return out;
+  }
+}
+
+auto main(int argc, char* argv[]) -> int {
+  auto iterations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+  auto rounds = argc > 2 ? std::atoi(argv[2]) : 5;
+  auto body = argc > 3 ? static_cast<std::size_t>(std::strtoull(argv[3], nullptr, 10)) : 8;
+  auto flags = ud2::luogu3::bench::compiler_flags("-O2");
+  auto result = ud2::luogu3::compile(ud2::luogu3::bench::arithmetic_source(body));
+  if (!result.diags.empty()) {
+    std::cerr << "generated source failed to compile: " << result.diags.front().message << '\n';
+    return 1;
+  }
+  auto pipeline = ud2::luogu3::preset_pipeline(ud2::luogu3::default_opt_level);
+  pipeline.push_back(ud2::luogu3::find_pass("fuse"));
+  auto state = ud2::luogu3::pass_state{result.prog};
+  ud2::luogu3::run_pipeline(state, pipeline);
+  auto dir = ud2::luogu3::bench::scratch_directory{"runtime"};
+  std::ofstream{dir.path() / "input"} << iterations << '\n';
+  struct variant {
+    const char* name;
+    bool cache_top;
+    bool fuse;
+  };
+  auto expected = std::string{};
+  std::cout << "runtime: " << iterations << " iterations, " << body << " steps per iteration, " << rounds << " rounds, " << ud2::luogu3::bench::compiler() << ' ' << flags << '\n';
+  for (auto [name, cache_top, fuse] : {variant{"checked", false, false}, variant{"cached", true, false}, variant{"fused", false, true}, variant{"fused+cached", true, true}}) {
+    auto options = ud2::luogu3::emit_options{};
+    options.stack_capacity = ud2::luogu3::stack_capacity;
+    options.cache_top = cache_top;
+    options.origin = state.origin;
+    options.hints = state.hints;
+    options.idioms = state.idioms;
+    if (fuse)
+      options.fused = state.fused;
+    auto output = dir.path() / (std::string{name} + ".out");
+    if (!dir.build(name, flags, [&](std::ostream& out) { result.prog.emit_c(out, options); }))
+      return 1;
+    auto command = (dir.path() / name).string() + " < " + (dir.path() / "input").string() + " > " + output.string();
+    auto best = 0.0;
+    for (auto i = 0; i < rounds; ++i) {
+      auto start = std::chrono::steady_clock::now();
+      if (std::system(command.c_str())) {
+        std::cerr << "emitted program failed: " << name << '\n';
+        return 1;
+      }
+      auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      if (!i || seconds < best)
+        best = seconds;
+    }
+    auto file = std::ifstream{output};
+    auto text = std::string{std::istreambuf_iterator<char>{file}, {}};
+    if (expected.empty())
+      expected = text;
+    else if (text != expected) {
+      std::cerr << "outputs differ: " << name << '\n';
+      return 1;
+    }
+    std::cout << "  " << name << ": " << best << " s, " << (static_cast<double>(iterations) / best / 1e6) << " M iterations/s\n";
+  }
+  return 0;
+}
@@ -0,0 +1,94 @@
+#include <cstdlib>
+#include <harness.hpp>
+#include <iostream>
+#include <luogu3/program.hpp>
+#include <string>
+
+namespace ud2::luogu3::bench {
+  // Runs the emitted T00, T01 and T02 kernels and straightforward loops that
+  // reduce with % on the same pseudo-random values below the modulus. Short
+  // segments, including empty ones, are first checked at the very end of a
+  // stack that is followed by an inaccessible page, as under --guard-pages.
+  auto emit_harness(std::ostream& out, std::size_t k, int rounds) -> void {
+    auto kernels = runtime_kernels{};
+    kernels.prefix_sum = true;
+    kernels.suffix_sum = true;
+    kernels.finite_difference = true;
+    emit_harness_prologue(out);
+    emit_runtime(out, k, kernels);
+    out
+      << "#include <sys/mman.h>\n"
+      << "#include <unistd.h>\n"
+      << "\n"
+      << "#ifndef MAP_ANONYMOUS\n"
+      << "#define MAP_ANONYMOUS MAP_ANON\n"
+      << "#endif\n"
+      << "\n"
+      << "#define K " << k << "\n"
+      << "\n"
+      << "static void reference_prefix_sum(uint_least32_t* ptr, uint_least32_t k) {\n"
+      << "  for (uint_least32_t i = 1; i < k; ++i)\n"
+      << "    ptr[k - i - 1] = (uint_least32_t) ((ptr[k - i - 1] + (uint_least64_t) ptr[k - i]) % P);\n"
+      << "}\n"
+      << "\n"
+      << "static void reference_suffix_sum(uint_least32_t* ptr, uint_least32_t k) {\n"
+      << "  for (uint_least32_t i = 1; i < k; ++i)\n"
+      << "    ptr[i] = (uint_least32_t) ((ptr[i] + (uint_least64_t) ptr[i - 1]) % P);\n"
+      << "}\n"
+      << "\n"
+      << "static void reference_finite_difference(uint_least32_t* ptr, uint_least32_t k) {\n"
+      << "  for (uint_least32_t i = 1; i < k; ++i)\n"
+      << "    ptr[i - 1] = (uint_least32_t) ((P + ptr[i - 1] - ptr[i]) % P);\n"
+      << "}\n"
+      << "\n"
+      << "static uint_least32_t data[K];\n"
+      << "\n"
+      << "static uint_least32_t* stack_end(size_t page) {\n"
+      << "  char* base = (char*) mmap(NULL, 2 * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);\n"
+      << "  if (base == (char*) MAP_FAILED || mprotect(base + page, page, PROT_NONE)) {\n"
+      << "    perror(\"mmap\");\n"
+      << "    exit(1);\n"
+      << "  }\n"
+      << "  return (uint_least32_t*) (base + page);\n"
+      << "}\n"
+      << "\n"
+      << "static int check_full_stack(const char* name, kernel_fn kernel, kernel_fn reference) {\n"
+      << "  static uint_least32_t* end[2];\n"
+      << "  size_t page = (size_t) sysconf(_SC_PAGESIZE);\n"
+      << "  if (!end[0]) {\n"
+      << "    end[0] = stack_end(page);\n"
+      << "    end[1] = stack_end(page);\n"
+      << "  }\n"
+      << "  for (uint_least32_t k = 0; k <= 16 && k <= K; ++k) {\n"
+      << "    memcpy(end[0] - k, data, k * sizeof *data);\n"
+      << "    memcpy(end[1] - k, data, k * sizeof *data);\n"
+      << "    kernel(end[0] - k, k);\n"
+      << "    reference(end[1] - k, k);\n"
+      << "    if (!check_same(name, end[0] - k, end[1] - k, k))\n"
+      << "      return 0;\n"
+      << "  }\n"
+      << "  return 1;\n"
+      << "}\n"
+      << "\n"
+      << "int main(void) {\n"
+      << "  fill_random(data, K, 0, P);\n"
+      << "  if (!check_full_stack(\"T00 prefix sum\", prefix_sum, reference_prefix_sum)\n"
+      << "    || !check_full_stack(\"T01 suffix sum\", suffix_sum, reference_suffix_sum)\n"
+      << "    || !check_full_stack(\"T02 finite difference\", finite_difference, reference_finite_difference))\n"
+      << "    return 1;\n"
+      << "  return !(compare(\"T00 prefix sum\", prefix_sum, reference_prefix_sum, data, K, " << rounds << ", K * 8.0)\n"
+      << "    && compare(\"T01 suffix sum\", suffix_sum, reference_suffix_sum, data, K, " << rounds << ", K * 8.0)\n"
+      << "    && compare(\"T02 finite difference\", finite_difference, reference_finite_difference, data, K, " << rounds << ", K * 8.0));\n"
+      << "}\n";
+  }
+}
+
+auto main(int argc, char* argv[]) -> int {
+  auto k = argc > 1 ? static_cast<std::size_t>(std::strtoull(argv[1], nullptr, 10)) : 1000000;
+  auto rounds = argc > 2 ? std::atoi(argv[2]) : 50;
+  if (!k || rounds < 1) {
+    std::cerr << "k and rounds must be positive\n";
+    return 2;
+  }
+  return ud2::luogu3::bench::run_harness("scans", std::to_string(k) + " elements, " + std::to_string(rounds) + " rounds", [&](std::ostream& out) { ud2::luogu3::bench::emit_harness(out, k, rounds); });
+}
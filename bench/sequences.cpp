@@ -0,0 +1,82 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <luogu3/analysis.hpp>
+#include <luogu3/cfg.hpp>
+#include <luogu3/compile.hpp>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ud2::luogu3::bench {
+  auto mnemonic(const state& s) -> std::string {
+    auto out = std::ostringstream{};
+    std::visit([&](const auto& s) { s.emit_source(out); }, s);
+    auto text = out.str();
+    return text.substr(0, text.find_first_of(" \n"));
+  }
+}
+
+auto main(int argc, char* argv[]) -> int {
+  if (argc < 3) {
+    std::cerr << "Usage: " << *argv << " <length> <file>...\n";
+    return 2;
+  }
+  auto length = static_cast<std::size_t>(std::strtoull(argv[1], nullptr, 10));
+  if (length < 2) {
+    std::cerr << "length must be at least 2\n";
+    return 2;
+  }
+  struct frequency {
+    std::size_t count = 0;
+    std::size_t fused = 0;
+  };
+  auto counts = std::map<std::string, frequency>{};
+  auto states = static_cast<std::size_t>(0);
+  auto fused_states = static_cast<std::size_t>(0);
+  for (auto i = 2; i < argc; ++i) {
+    auto file = std::ifstream{argv[i]};
+    if (!file) {
+      std::cerr << argv[i] << ": cannot open\n";
+      return 1;
+    }
+    auto source = std::string{std::istreambuf_iterator<char>{file}, {}};
+    auto result = ud2::luogu3::compile(source);
+    if (!result.diags.empty()) {
+      std::cerr << argv[i] << ": " << result.diags.front().message << '\n';
+      continue;
+    }
+    const auto& prog = result.prog;
+    auto g = ud2::luogu3::cfg{prog};
+    auto hints = std::vector<ud2::luogu3::emit_hints>{};
+    auto fused = std::vector<std::size_t>{};
+    ud2::luogu3::operand_hints(prog, hints);
+    states += prog.states.size();
+    fused_states += ud2::luogu3::fusion_chains(prog, hints, fused);
+    for (auto s = static_cast<std::size_t>(0); s < prog.states.size(); ++s) {
+      auto key = ud2::luogu3::bench::mnemonic(prog.states[s]);
+      auto all_fused = true;
+      for (auto [t, n] = std::pair{s, static_cast<std::size_t>(1)}; n < length; ++n) {
+        auto succs = g.successors(t);
+        if (succs.size() != 1 || g.predecessors(succs[0]).size() != 1 || succs[0] == prog.init)
+          break;
+        all_fused = all_fused && fused[t] == succs[0];
+        t = succs[0];
+        key += ' ' + ud2::luogu3::bench::mnemonic(prog.states[t]);
+        auto& f = counts[key];
+        ++f.count;
+        f.fused += all_fused;
+      }
+    }
+  }
+  auto sorted = std::vector<std::pair<std::string, frequency>>(counts.begin(), counts.end());
+  std::stable_sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.second.count > b.second.count; });
+  std::cout << "sequences: " << states << " states, " << fused_states << " fused\n";
+  for (auto i = static_cast<std::size_t>(0); i < sorted.size() && i < 50; ++i)
+    std::cout << "  " << sorted[i].first << ": " << sorted[i].second.count << " (" << sorted[i].second.fused << " fused)\n";
+  return 0;
+}
@@ -0,0 +1,68 @@
+#include <algorithm>
+#include <cstdlib>
+#include <harness.hpp>
+#include <iostream>
+#include <luogu3/program.hpp>
+#include <sstream>
+
+namespace ud2::luogu3::bench {
+  // Times the emitted sort kernel against qsort on the same pseudo-random
+  // values below the modulus, for k from 10 to max_k in steps of 10. Each
+  // round sorts a buffer of at least 2^20 values in consecutive runs of k.
+  auto emit_harness(std::ostream& out, std::size_t max_k, double elements) -> void {
+    auto n = std::max(max_k, static_cast<std::size_t>(1) << 20);
+    auto kernels = runtime_kernels{};
+    kernels.sort = true;
+    emit_harness_prologue(out);
+    emit_runtime(out, max_k, kernels);
+    out
+      << "#define N " << n << "\n"
+      << "\n"
+      << "static uint_least32_t chunk;\n"
+      << "\n"
+      << "static int compare_values(const void* a, const void* b) {\n"
+      << "  uint_least32_t x = *(const uint_least32_t*) a;\n"
+      << "  uint_least32_t y = *(const uint_least32_t*) b;\n"
+      << "  return (x > y) - (x < y);\n"
+      << "}\n"
+      << "\n"
+      << "static void kernel_sort(uint_least32_t* ptr, uint_least32_t k) {\n"
+      << "  for (uint_least32_t i = 0; i < k; i += chunk)\n"
+      << "    sort_segment(ptr + i, k - i < chunk ? k - i : chunk, 0);\n"
+      << "}\n"
+      << "\n"
+      << "static void reference_sort(uint_least32_t* ptr, uint_least32_t k) {\n"
+      << "  for (uint_least32_t i = 0; i < k; i += chunk)\n"
+      << "    qsort(ptr + i, k - i < chunk ? k - i : chunk, sizeof *ptr, compare_values);\n"
+      << "}\n"
+      << "\n"
+      << "static uint_least32_t data[N];\n"
+      << "static uint_least32_t result[2][N];\n"
+      << "\n"
+      << "int main(void) {\n"
+      << "  long rounds = (long) (" << elements << " / N) + 1;\n"
+      << "  fill_random(data, N, 0, P);\n"
+      << "  for (chunk = 10; chunk <= " << max_k << "; chunk *= 10) {\n"
+      << "    double seconds[2];\n"
+      << "    seconds[0] = time_in_place(kernel_sort, data, result[0], N, rounds);\n"
+      << "    seconds[1] = time_in_place(reference_sort, data, result[1], N, rounds);\n"
+      << "    if (!check_same(\"sort\", result[0], result[1], N))\n"
+      << "      return 1;\n"
+      << "    printf(\"  k = %\" PRIuLEAST32 \": radix %.2f ns, qsort %.2f ns per element, %.2fx\\n\", chunk, seconds[0] * 1e9 / N, seconds[1] * 1e9 / N, seconds[1] / seconds[0]);\n"
+      << "  }\n"
+      << "  return 0;\n"
+      << "}\n";
+  }
+}
+
+auto main(int argc, char* argv[]) -> int {
+  auto max_k = argc > 1 ? static_cast<std::size_t>(std::strtoull(argv[1], nullptr, 10)) : 1000000;
+  auto elements = argc > 2 ? std::strtod(argv[2], nullptr) : 3e7;
+  if (max_k < 10) {
+    std::cerr << "k must be at least 10\n";
+    return 2;
+  }
+  auto title = std::ostringstream{};
+  title << "up to " << max_k << " elements, about " << elements << " elements per size";
+  return ud2::luogu3::bench::run_harness("sort", title.str(), [&](std::ostream& out) { ud2::luogu3::bench::emit_harness(out, max_k, elements); });
+}
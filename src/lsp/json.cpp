@@ -0,0 +1,368 @@
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <lsp/json.hpp>
+#include <ostream>
+#include <stdexcept>
+#include <system_error>
+
+namespace ud2::luogu3::lsp::json {
+  namespace detail {
+    class parser {
+      const char* ptr;
+      const char* end;
+      std::size_t depth = 0;
+
+    public:
+      parser(std::string_view text) noexcept : ptr{text.data()}, end{text.data() + text.size()} {}
+
+      auto parse_document() -> value {
+        auto v = this->parse_value();
+        this->skip_space();
+        if (this->ptr != this->end)
+          throw std::invalid_argument{"trailing characters after JSON value"};
+        return v;
+      }
+
+    private:
+      auto skip_space() noexcept -> void {
+        while (this->ptr != this->end && (*this->ptr == ' ' || *this->ptr == '\t' || *this->ptr == '\n' || *this->ptr == '\r'))
+          ++this->ptr;
+      }
+
+      auto consume(char ch) -> void {
+        this->skip_space();
+        if (this->ptr == this->end || *this->ptr != ch)
+          throw std::invalid_argument{std::string{"expected '"} + ch + "' in JSON"};
+        ++this->ptr;
+      }
+
+      auto consume_literal(std::string_view literal) -> void {
+        if (static_cast<std::size_t>(this->end - this->ptr) < literal.size() || std::string_view{this->ptr, literal.size()} != literal)
+          throw std::invalid_argument{"invalid JSON literal"};
+        this->ptr += literal.size();
+      }
+
+      auto parse_value() -> value {
+        if (++this->depth > 256)
+          throw std::invalid_argument{"JSON nested too deeply"};
+        this->skip_space();
+        if (this->ptr == this->end)
+          throw std::invalid_argument{"unexpected end of JSON"};
+        auto result = value{};
+        switch (*this->ptr) {
+          case 'n':
+            this->consume_literal("null");
+            break;
+          case 't':
+            this->consume_literal("true");
+            result = true;
+            break;
+          case 'f':
+            this->consume_literal("false");
+            result = false;
+            break;
+          case '"':
+            result = this->parse_string();
+            break;
+          case '[':
+            result = this->parse_array();
+            break;
+          case '{':
+            result = this->parse_object();
+            break;
+          default:
+            result = this->parse_number();
+            break;
+        }
+        --this->depth;
+        return result;
+      }
+
+      auto skip_digits(const char* pos) const noexcept -> const char* {
+        while (pos != this->end && *pos >= '0' && *pos <= '9')
+          ++pos;
+        return pos;
+      }
+
+      // from_chars also accepts inf, nan, hexadecimal floats and leading
+      // zeros, so the span is first matched against the JSON grammar.
+      auto number_end() const -> const char* {
+        auto pos = this->ptr;
+        if (pos != this->end && *pos == '-')
+          ++pos;
+        if (pos == this->end || *pos < '0' || *pos > '9')
+          throw std::invalid_argument{"invalid JSON number"};
+        pos = *pos == '0' ? pos + 1 : this->skip_digits(pos);
+        if (pos != this->end && *pos == '.') {
+          auto digits = pos + 1;
+          pos = this->skip_digits(digits);
+          if (pos == digits)
+            throw std::invalid_argument{"invalid JSON number"};
+        }
+        if (pos != this->end && (*pos == 'e' || *pos == 'E')) {
+          ++pos;
+          if (pos != this->end && (*pos == '+' || *pos == '-'))
+            ++pos;
+          auto digits = pos;
+          pos = this->skip_digits(digits);
+          if (pos == digits)
+            throw std::invalid_argument{"invalid JSON number"};
+        }
+        return pos;
+      }
+
+      auto parse_number() -> value {
+        auto last = this->number_end();
+        double n;
+        auto conv = std::from_chars(this->ptr, last, n);
+        if (conv.ec != std::errc{} || conv.ptr != last)
+          throw std::invalid_argument{"invalid JSON number"};
+        this->ptr = last;
+        return n;
+      }
+
+      auto parse_hex4() -> std::uint_least32_t {
+        if (this->end - this->ptr < 4)
+          throw std::invalid_argument{"invalid JSON escape"};
+        std::uint_least32_t code;
+        auto conv = std::from_chars(this->ptr, this->ptr + 4, code, 16);
+        if (conv.ec != std::errc{} || conv.ptr != this->ptr + 4)
+          throw std::invalid_argument{"invalid JSON escape"};
+        this->ptr += 4;
+        return code;
+      }
+
+      static auto append_utf8(std::string& s, std::uint_least32_t code) -> void {
+        if (code < 0x80)
+          s += static_cast<char>(code);
+        else if (code < 0x800) {
+          s += static_cast<char>(0xc0 | code >> 6);
+          s += static_cast<char>(0x80 | (code & 0x3f));
+        } else if (code < 0x10000) {
+          s += static_cast<char>(0xe0 | code >> 12);
+          s += static_cast<char>(0x80 | (code >> 6 & 0x3f));
+          s += static_cast<char>(0x80 | (code & 0x3f));
+        } else {
+          s += static_cast<char>(0xf0 | code >> 18);
+          s += static_cast<char>(0x80 | (code >> 12 & 0x3f));
+          s += static_cast<char>(0x80 | (code >> 6 & 0x3f));
+          s += static_cast<char>(0x80 | (code & 0x3f));
+        }
+      }
+
+      auto parse_string() -> std::string {
+        this->consume('"');
+        auto s = std::string{};
+        for (;;) {
+          if (this->ptr == this->end)
+            throw std::invalid_argument{"unterminated JSON string"};
+          auto ch = *this->ptr++;
+          if (ch == '"')
+            return s;
+          if (static_cast<unsigned char>(ch) < 0x20)
+            throw std::invalid_argument{"control character in JSON string"};
+          if (ch != '\\') {
+            s += ch;
+            continue;
+          }
+          if (this->ptr == this->end)
+            throw std::invalid_argument{"unterminated JSON string"};
+          switch (*this->ptr++) {
+            case '"':
+              s += '"';
+              break;
+            case '\\':
+              s += '\\';
+              break;
+            case '/':
+              s += '/';
+              break;
+            case 'b':
+              s += '\b';
+              break;
+            case 'f':
+              s += '\f';
+              break;
+            case 'n':
+              s += '\n';
+              break;
+            case 'r':
+              s += '\r';
+              break;
+            case 't':
+              s += '\t';
+              break;
+            case 'u': {
+              auto code = this->parse_hex4();
+              if (code >= 0xd800 && code < 0xdc00 && this->end - this->ptr >= 6 && this->ptr[0] == '\\' && this->ptr[1] == 'u') {
+                this->ptr += 2;
+                auto low = this->parse_hex4();
+                if (low >= 0xdc00 && low < 0xe000)
+                  code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                else {
+                  append_utf8(s, 0xfffd);
+                  code = low;
+                }
+              }
+              append_utf8(s, code >= 0xd800 && code < 0xe000 ? 0xfffd : code);
+              break;
+            }
+            default:
+              throw std::invalid_argument{"invalid JSON escape"};
+          }
+        }
+      }
+
+      auto parse_array() -> array {
+        this->consume('[');
+        auto a = array{};
+        this->skip_space();
+        if (this->ptr != this->end && *this->ptr == ']') {
+          ++this->ptr;
+          return a;
+        }
+        for (;;) {
+          a.push_back(this->parse_value());
+          this->skip_space();
+          if (this->ptr != this->end && *this->ptr == ']') {
+            ++this->ptr;
+            return a;
+          }
+          this->consume(',');
+        }
+      }
+
+      auto parse_object() -> object {
+        this->consume('{');
+        auto o = object{};
+        this->skip_space();
+        if (this->ptr != this->end && *this->ptr == '}') {
+          ++this->ptr;
+          return o;
+        }
+        for (;;) {
+          this->skip_space();
+          auto key = this->parse_string();
+          this->consume(':');
+          o.emplace_back(std::move(key), this->parse_value());
+          this->skip_space();
+          if (this->ptr != this->end && *this->ptr == '}') {
+            ++this->ptr;
+            return o;
+          }
+          this->consume(',');
+        }
+      }
+    };
+
+    auto write_string(std::ostream& out, const std::string& s) -> void {
+      out << '"';
+      for (auto ch : s) {
+        switch (ch) {
+          case '"':
+            out << "\\\"";
+            break;
+          case '\\':
+            out << "\\\\";
+            break;
+          case '\n':
+            out << "\\n";
+            break;
+          case '\r':
+            out << "\\r";
+            break;
+          case '\t':
+            out << "\\t";
+            break;
+          default:
+            if (static_cast<unsigned char>(ch) < 0x20)
+              out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(ch) << std::dec;
+            else
+              out << ch;
+            break;
+        }
+      }
+      out << '"';
+    }
+
+    const auto null = value{};
+  }
+
+  auto value::is_null() const noexcept -> bool {
+    return std::holds_alternative<std::nullptr_t>(this->data);
+  }
+
+  auto value::as_number() const noexcept -> const double* {
+    return std::get_if<double>(&this->data);
+  }
+
+  auto value::as_string() const noexcept -> const std::string* {
+    return std::get_if<std::string>(&this->data);
+  }
+
+  auto value::as_array() const noexcept -> const array* {
+    return std::get_if<array>(&this->data);
+  }
+
+  auto value::as_object() const noexcept -> const object* {
+    return std::get_if<object>(&this->data);
+  }
+
+  auto value::operator[](std::string_view key) const noexcept -> const value& {
+    if (auto o = this->as_object())
+      for (const auto& [k, v] : *o)
+        if (k == key)
+          return v;
+    return detail::null;
+  }
+
+  auto parse(std::string_view text) -> value {
+    return detail::parser{text}.parse_document();
+  }
+
+  auto operator<<(std::ostream& out, const value& v) -> std::ostream& {
+    std::visit(
+      [&](const auto& x) {
+        using T = std::decay_t<decltype(x)>;
+        if constexpr (std::is_same_v<T, std::nullptr_t>)
+          out << "null";
+        else if constexpr (std::is_same_v<T, bool>)
+          out << (x ? "true" : "false");
+        else if constexpr (std::is_same_v<T, double>) {
+          if (std::isfinite(x) && x == std::trunc(x) && std::fabs(x) < 1e15)
+            out << static_cast<long long>(x);
+          else if (std::isfinite(x))
+            out << std::setprecision(17) << x;
+          else
+            out << "null";
+        } else if constexpr (std::is_same_v<T, std::string>)
+          detail::write_string(out, x);
+        else if constexpr (std::is_same_v<T, array>) {
+          out << '[';
+          auto first = true;
+          for (const auto& e : x) {
+            if (!first)
+              out << ',';
+            first = false;
+            out << e;
+          }
+          out << ']';
+        } else {
+          out << '{';
+          auto first = true;
+          for (const auto& [k, e] : x) {
+            if (!first)
+              out << ',';
+            first = false;
+            detail::write_string(out, k);
+            out << ':' << e;
+          }
+          out << '}';
+        }
+      },
+      v.data);
+    return out;
+  }
+}
@@ -0,0 +1,45 @@
+#ifndef LUOGU3_LSP_JSON_HPP
+#define LUOGU3_LSP_JSON_HPP
+
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace ud2::luogu3::lsp::json {
+  class value;
+  using array = std::vector<value>;
+  using object = std::vector<std::pair<std::string, value>>;
+
+  class value {
+  public:
+    std::variant<std::nullptr_t, bool, double, std::string, array, object> data;
+
+    value() noexcept : data{nullptr} {}
+    value(std::nullptr_t) noexcept : data{nullptr} {}
+    value(bool b) noexcept : data{b} {}
+    template <class T, std::enable_if_t<std::is_arithmetic_v<T> && !std::is_same_v<T, bool>, int> = 0>
+    value(T n) noexcept : data{static_cast<double>(n)} {}
+    value(const char* s) : data{std::string{s}} {}
+    value(std::string_view s) : data{std::string{s}} {}
+    value(std::string s) noexcept : data{std::move(s)} {}
+    value(array a) noexcept : data{std::move(a)} {}
+    value(object o) noexcept : data{std::move(o)} {}
+
+    auto is_null() const noexcept -> bool;
+    auto as_number() const noexcept -> const double*;
+    auto as_string() const noexcept -> const std::string*;
+    auto as_array() const noexcept -> const array*;
+    auto as_object() const noexcept -> const object*;
+    auto operator[](std::string_view key) const noexcept -> const value&;
+  };
+
+  auto parse(std::string_view text) -> value;
+  auto operator<<(std::ostream& out, const value& v) -> std::ostream&;
+}
+
+#endif
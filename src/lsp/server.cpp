@@ -0,0 +1,434 @@
+#include <algorithm>
+#include <charconv>
+#include <config.h>
+#include <cstring>
+#include <istream>
+#include <lsp/json.hpp>
+#include <lsp/server.hpp>
+#include <optional>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+namespace ud2::luogu3::lsp {
+  namespace detail {
+    constexpr auto parse_error = -32700;
+    constexpr auto invalid_params = -32602;
+    constexpr auto method_not_found = -32601;
+    constexpr auto internal_error = -32603;
+
+    // Longer messages are skipped unread instead of buffered, so a bogus
+    // Content-Length cannot exhaust memory.
+    constexpr auto max_message_length = static_cast<std::size_t>(1) << 26;
+
+    struct document {
+      std::string text;
+      std::vector<std::size_t> starts;
+      compile_result result;
+    };
+
+    struct token {
+      std::size_t start;
+      std::size_t end;
+    };
+
+    constexpr auto is_space(unsigned char ch) noexcept -> bool {
+      return ch == ' ' || ch == '\t' || ch == '\v' || ch == '\f' || ch == '\r';
+    }
+
+    auto read_message(std::istream& in, std::string& body) -> bool {
+      constexpr auto prefix = std::string_view{"Content-Length:"};
+      auto length = static_cast<std::size_t>(-1);
+      auto line = std::string{};
+      for (;;) {
+        if (!std::getline(in, line))
+          return false;
+        if (!line.empty() && line.back() == '\r')
+          line.pop_back();
+        if (line.empty()) {
+          if (~length)
+            break;
+          continue;
+        }
+        if (line.compare(0, prefix.size(), prefix) == 0) {
+          auto ptr = line.data() + prefix.size();
+          auto end = line.data() + line.size();
+          while (ptr != end && *ptr == ' ')
+            ++ptr;
+          std::from_chars(ptr, end, length);
+        }
+      }
+      if (length > max_message_length) {
+        body.clear();
+        while (length && in.ignore(static_cast<std::streamsize>(std::min(length, max_message_length))))
+          length -= static_cast<std::size_t>(in.gcount());
+        return !length;
+      }
+      body.resize(length);
+      in.read(body.data(), static_cast<std::streamsize>(length));
+      return static_cast<std::size_t>(in.gcount()) == length;
+    }
+
+    auto write_message(std::ostream& out, const json::value& message) -> void {
+      auto body = std::ostringstream{};
+      body << message;
+      auto text = std::move(body).str();
+      out << "Content-Length: " << text.size() << "\r\n\r\n"
+          << text;
+      out.flush();
+    }
+
+    auto line_starts(std::string_view text) -> std::vector<std::size_t> {
+      auto starts = std::vector<std::size_t>{0};
+      for (auto ptr = text.data(), end = text.data() + text.size();;) {
+        auto newline = static_cast<const char*>(std::memchr(ptr, '\n', static_cast<std::size_t>(end - ptr)));
+        if (!newline)
+          break;
+        ptr = newline + 1;
+        starts.push_back(static_cast<std::size_t>(ptr - text.data()));
+      }
+      return starts;
+    }
+
+    // Replaces [start, end) of the text by `text` in the line starts of the
+    // old text.
+    auto patch_line_starts(std::vector<std::size_t>& starts, std::size_t start, std::size_t end, std::string_view text) -> void {
+      auto first = std::upper_bound(starts.begin(), starts.end(), start);
+      auto last = std::upper_bound(first, starts.end(), end);
+      auto delta = text.size() - (end - start);
+      for (auto it = last; it != starts.end(); ++it)
+        *it += delta;
+      auto fresh = line_starts(text);
+      for (auto& pos : fresh)
+        pos += start;
+      auto at = starts.erase(first, last);
+      starts.insert(at, fresh.begin() + 1, fresh.end());
+    }
+
+    auto find_tokens(std::string_view text, std::size_t start) -> std::vector<token> {
+      auto tokens = std::vector<token>{};
+      auto end = text.find('\n', start);
+      if (!~end)
+        end = text.size();
+      for (auto pos = start; pos < end;) {
+        while (pos < end && is_space(text[pos]))
+          ++pos;
+        if (pos == end)
+          break;
+        auto begin = pos;
+        while (pos < end && !is_space(text[pos]))
+          ++pos;
+        tokens.push_back({begin, pos});
+      }
+      return tokens;
+    }
+
+    class server {
+      std::istream& in;
+      std::ostream& out;
+      compile_options options;
+      std::unordered_map<std::string, document> documents;
+      bool utf8 = false;
+      bool shutdown = false;
+
+    public:
+      server(std::istream& in, std::ostream& out, const compile_options& options) : in{in}, out{out}, options{options} {}
+
+      auto run() -> int {
+        auto body = std::string{};
+        while (read_message(this->in, body)) {
+          auto message = json::value{};
+          try {
+            message = json::parse(body);
+          } catch (const std::invalid_argument& e) {
+            this->respond_error(nullptr, parse_error, e.what());
+            continue;
+          }
+          const auto& id = message["id"];
+          auto method = message["method"].as_string();
+          if (!method)
+            continue;
+          if (*method == "exit")
+            return this->shutdown ? 0 : 1;
+          try {
+            auto result = this->dispatch(*method, message["params"]);
+            if (!id.is_null()) {
+              if (result)
+                this->respond(id, std::move(*result));
+              else
+                this->respond_error(id, method_not_found, "method not found: " + *method);
+            }
+          } catch (const std::invalid_argument& e) {
+            if (!id.is_null())
+              this->respond_error(id, invalid_params, e.what());
+          } catch (const std::exception& e) {
+            if (!id.is_null())
+              this->respond_error(id, internal_error, e.what());
+          }
+        }
+        return 1;
+      }
+
+    private:
+      auto dispatch(const std::string& method, const json::value& params) -> std::optional<json::value> {
+        if (method == "initialize")
+          return this->initialize(params);
+        if (method == "shutdown") {
+          this->shutdown = true;
+          return nullptr;
+        }
+        if (method == "textDocument/didOpen") {
+          this->did_open(params);
+          return nullptr;
+        }
+        if (method == "textDocument/didChange") {
+          this->did_change(params);
+          return nullptr;
+        }
+        if (method == "textDocument/didClose") {
+          this->did_close(params);
+          return nullptr;
+        }
+        if (method == "textDocument/definition")
+          return this->definition(params);
+        if (method == "initialized" || method.compare(0, 2, "$/") == 0)
+          return nullptr;
+        return std::nullopt;
+      }
+
+      auto respond(const json::value& id, json::value result) -> void {
+        write_message(this->out, json::object{
+          {"jsonrpc", "2.0"},
+          {"id", id},
+          {"result", std::move(result)},
+        });
+      }
+
+      auto respond_error(const json::value& id, int code, std::string message) -> void {
+        write_message(this->out, json::object{
+          {"jsonrpc", "2.0"},
+          {"id", id},
+          {"error", json::object{
+            {"code", code},
+            {"message", std::move(message)},
+          }},
+        });
+      }
+
+      auto initialize(const json::value& params) -> json::value {
+        if (auto encodings = params["capabilities"]["general"]["positionEncodings"].as_array())
+          this->utf8 = std::any_of(encodings->begin(), encodings->end(), [](const json::value& e) {
+            auto s = e.as_string();
+            return s && *s == "utf-8";
+          });
+        return json::object{
+          {"capabilities", json::object{
+            {"positionEncoding", this->utf8 ? "utf-8" : "utf-16"},
+            {"textDocumentSync", json::object{
+              {"openClose", true},
+              {"change", 2},
+            }},
+            {"definitionProvider", true},
+          }},
+          {"serverInfo", json::object{
+            {"name", "luogu3c"},
+            {"version", PACKAGE_VERSION},
+          }},
+        };
+      }
+
+      static auto uri_of(const json::value& params) -> const std::string& {
+        auto uri = params["textDocument"]["uri"].as_string();
+        if (!uri)
+          throw std::invalid_argument{"missing textDocument.uri"};
+        return *uri;
+      }
+
+      auto did_open(const json::value& params) -> void {
+        const auto& uri = uri_of(params);
+        auto text = params["textDocument"]["text"].as_string();
+        if (!text)
+          throw std::invalid_argument{"missing textDocument.text"};
+        auto& doc = this->documents[uri];
+        doc.text = *text;
+        doc.starts = line_starts(doc.text);
+        doc.result = compile(doc.text, this->options);
+        this->publish(uri, doc);
+      }
+
+      auto did_change(const json::value& params) -> void {
+        const auto& uri = uri_of(params);
+        auto it = this->documents.find(uri);
+        if (it == this->documents.end())
+          throw std::invalid_argument{"document is not open: " + uri};
+        auto& doc = it->second;
+        auto changes = params["contentChanges"].as_array();
+        if (!changes)
+          throw std::invalid_argument{"missing contentChanges"};
+        for (const auto& change : *changes) {
+          auto text = change["text"].as_string();
+          if (!text)
+            throw std::invalid_argument{"missing contentChanges[].text"};
+          const auto& range = change["range"];
+          if (range.is_null()) {
+            doc.text = *text;
+            doc.starts = line_starts(doc.text);
+            doc.result = compile(doc.text, this->options);
+            continue;
+          }
+          auto start = this->to_offset(doc.text, doc.starts, range["start"]);
+          auto end = std::max(start, this->to_offset(doc.text, doc.starts, range["end"]));
+          recompile(doc.result, doc.text, {start, end, *text}, this->options);
+          patch_line_starts(doc.starts, start, end, *text);
+        }
+        this->publish(uri, doc);
+      }
+
+      auto did_close(const json::value& params) -> void {
+        const auto& uri = uri_of(params);
+        this->documents.erase(uri);
+        write_message(this->out, json::object{
+          {"jsonrpc", "2.0"},
+          {"method", "textDocument/publishDiagnostics"},
+          {"params", json::object{
+            {"uri", uri},
+            {"diagnostics", json::array{}},
+          }},
+        });
+      }
+
+      auto definition(const json::value& params) -> json::value {
+        const auto& uri = uri_of(params);
+        auto it = this->documents.find(uri);
+        if (it == this->documents.end())
+          return nullptr;
+        const auto& doc = it->second;
+        const auto& result = doc.result;
+        const auto& starts = doc.starts;
+        auto offset = this->to_offset(doc.text, starts, params["position"]);
+        auto line = static_cast<std::size_t>(std::upper_bound(starts.begin(), starts.end(), offset) - starts.begin() - 1);
+        auto tokens = find_tokens(doc.text, starts[line]);
+        auto it_token = std::find_if(tokens.begin(), tokens.end(), [&](const token& t) {
+          return t.start <= offset && offset <= t.end;
+        });
+        if (it_token == tokens.end())
+          return nullptr;
+        auto index = static_cast<std::size_t>(it_token - tokens.begin());
+        auto operand = false;
+        if (line == 0)
+          operand = index == 1;
+        else {
+          auto state_line = std::lower_bound(result.lines.begin(), result.lines.end(), tokens.front().start);
+          if (state_line == result.lines.end() || *state_line != tokens.front().start)
+            return nullptr;
+          auto i = static_cast<std::size_t>(state_line - result.lines.begin());
+          if (i >= result.prog.states.size())
+            return nullptr;
+          auto successors = std::visit([](const auto& s) -> std::size_t {
+            using S = std::decay_t<decltype(s)>;
+            if constexpr (std::is_same_v<S, state_terminate>)
+              return 0;
+            else if constexpr (std::is_same_v<S, state_empty> || std::is_same_v<S, state_less>)
+              return 2;
+            else
+              return 1;
+          }, result.prog.states[i]);
+          operand = index + successors >= tokens.size();
+        }
+        if (!operand)
+          return nullptr;
+        std::size_t target;
+        auto first = doc.text.data() + it_token->start;
+        auto last = doc.text.data() + it_token->end;
+        auto conv = std::from_chars(first, last, target);
+        if (conv.ec != std::errc{} || conv.ptr != last || target == 0 || target > result.lines.size() || target > result.prog.states.size())
+          return nullptr;
+        auto target_start = result.lines[target - 1];
+        auto target_tokens = find_tokens(doc.text, target_start);
+        return json::object{
+          {"uri", uri},
+          {"range", json::object{
+            {"start", this->to_position(doc.text, starts, target_start)},
+            {"end", this->to_position(doc.text, starts, target_tokens.back().end)},
+          }},
+        };
+      }
+
+      auto publish(const std::string& uri, const document& doc) -> void {
+        const auto& starts = doc.starts;
+        auto diagnostics = json::array{};
+        diagnostics.reserve(doc.result.diags.size());
+        for (const auto& diag : doc.result.diags)
+          diagnostics.push_back(json::object{
+            {"range", json::object{
+              {"start", this->to_position(doc.text, starts, diag.start)},
+              {"end", this->to_position(doc.text, starts, diag.end)},
+            }},
+            {"severity", 1},
+            {"source", "luogu3c"},
+            {"message", diag.message},
+          });
+        write_message(this->out, json::object{
+          {"jsonrpc", "2.0"},
+          {"method", "textDocument/publishDiagnostics"},
+          {"params", json::object{
+            {"uri", uri},
+            {"diagnostics", std::move(diagnostics)},
+          }},
+        });
+      }
+
+      auto to_position(std::string_view text, const std::vector<std::size_t>& starts, std::size_t offset) const -> json::value {
+        auto line = static_cast<std::size_t>(std::upper_bound(starts.begin(), starts.end(), offset) - starts.begin() - 1);
+        auto character = offset - starts[line];
+        if (!this->utf8) {
+          character = 0;
+          for (auto pos = starts[line]; pos < offset; ++pos) {
+            auto ch = static_cast<unsigned char>(text[pos]);
+            character += (ch & 0xc0) != 0x80;
+            character += ch >= 0xf0;
+          }
+        }
+        return json::object{
+          {"line", line},
+          {"character", character},
+        };
+      }
+
+      auto to_offset(std::string_view text, const std::vector<std::size_t>& starts, const json::value& position) const -> std::size_t {
+        auto line = position["line"].as_number();
+        auto character = position["character"].as_number();
+        if (!line || !character || *line < 0 || *character < 0)
+          throw std::invalid_argument{"invalid position"};
+        if (*line >= static_cast<double>(starts.size()))
+          return text.size();
+        auto start = starts[static_cast<std::size_t>(*line)];
+        auto end = text.find('\n', start);
+        if (!~end)
+          end = text.size();
+        auto units = static_cast<std::size_t>(*character);
+        if (this->utf8)
+          return std::min(start + units, end);
+        auto pos = start;
+        for (auto count = static_cast<std::size_t>(0); pos < end && count < units;) {
+          auto ch = static_cast<unsigned char>(text[pos]);
+          count += 1 + (ch >= 0xf0);
+          do
+            ++pos;
+          while (pos < end && (static_cast<unsigned char>(text[pos]) & 0xc0) == 0x80);
+        }
+        return pos;
+      }
+    };
+  }
+
+  auto serve(std::istream& in, std::ostream& out, const compile_options& options) -> int {
+    return detail::server{in, out, options}.run();
+  }
+}
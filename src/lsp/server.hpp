@@ -0,0 +1,11 @@
+#ifndef LUOGU3_LSP_SERVER_HPP
+#define LUOGU3_LSP_SERVER_HPP
+
+#include <iosfwd>
+#include <luogu3/compile.hpp>
+
+namespace ud2::luogu3::lsp {
+  auto serve(std::istream& in, std::ostream& out, const compile_options& options) -> int;
+}
+
+#endif
@@ -0,0 +1,593 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <luogu3/analysis.hpp>
+#include <luogu3/cfg.hpp>
+#include <type_traits>
+#include <variant>
+
+namespace ud2::luogu3 {
+  namespace detail {
+    constexpr auto widen_after = static_cast<std::size_t>(2);
+
+    struct checks {
+      std::size_t overflow = -1;
+      std::size_t underflow[3] = {static_cast<std::size_t>(-1), static_cast<std::size_t>(-1), static_cast<std::size_t>(-1)};
+    };
+
+    template <class S>
+    constexpr auto is_checked_binary = std::is_same_v<S, state_move> || std::is_same_v<S, state_copy>;
+
+    template <class S>
+    constexpr auto is_checked_ternary = std::is_same_v<S, state_add> || std::is_same_v<S, state_subtract> || std::is_same_v<S, state_multiply> || std::is_same_v<S, state_divide> || std::is_same_v<S, state_modulo>;
+
+    template <class S>
+    constexpr auto is_fusable = std::is_same_v<S, state_push> || std::is_same_v<S, state_pop> || is_checked_binary<S> || is_checked_ternary<S>;
+
+    template <class S>
+    constexpr auto ends_fusion = std::is_same_v<S, state_terminate> || std::is_same_v<S, state_empty> || std::is_same_v<S, state_less>;
+
+    template <class S>
+    constexpr auto is_scan = std::is_same_v<S, state_prefix_sum> || std::is_same_v<S, state_suffix_sum> || std::is_same_v<S, state_finite_difference>;
+
+    template <class S>
+    constexpr auto is_sort = std::is_same_v<S, state_sort_ascending> || std::is_same_v<S, state_sort_descending>;
+
+    template <class S>
+    constexpr auto is_segment_multiply = std::is_same_v<S, state_bulk_multiply> || std::is_same_v<S, state_vector_multiply>;
+
+    template <class S>
+    constexpr auto is_permutation = is_sort<S> || std::is_same_v<S, state_reverse> || std::is_same_v<S, state_rotate>;
+
+    template <class S>
+    constexpr auto is_segment = is_scan<S> || is_permutation<S> || is_segment_multiply<S>;
+
+    template <class S>
+    constexpr auto is_reduction = std::is_same_v<S, state_sum> || std::is_same_v<S, state_product>;
+
+    template <class S>
+    constexpr auto is_bulk_transfer = std::is_same_v<S, state_bulk_move> || std::is_same_v<S, state_bulk_copy>;
+
+    template <class S>
+    auto checks_of(const S& s) -> checks {
+      auto result = checks{};
+      if constexpr (std::is_same_v<S, state_push>)
+        result.overflow = s.target;
+      else if constexpr (std::is_same_v<S, state_pop> || is_scan<S> || is_sort<S> || std::is_same_v<S, state_reverse>)
+        result.underflow[0] = s.target;
+      else if constexpr (is_bulk_transfer<S>)
+        result.underflow[0] = s.from;
+      else if constexpr (is_checked_binary<S> || is_reduction<S>) {
+        result.overflow = s.target;
+        result.underflow[0] = s.from;
+      } else if constexpr (is_checked_ternary<S>) {
+        result.overflow = s.target;
+        result.underflow[0] = s.left;
+        result.underflow[1] = s.right;
+      } else if constexpr (std::is_same_v<S, state_less>) {
+        result.underflow[0] = s.left;
+        result.underflow[1] = s.right;
+      } else if constexpr (std::is_same_v<S, state_rotate>) {
+        result.underflow[0] = s.target;
+        result.underflow[1] = s.count;
+      } else if constexpr (std::is_same_v<S, state_bulk_multiply>) {
+        result.underflow[0] = s.target;
+        result.underflow[1] = s.from;
+      } else if constexpr (std::is_same_v<S, state_vector_multiply>) {
+        result.underflow[0] = s.target;
+        result.underflow[1] = s.left;
+        result.underflow[2] = s.right;
+      }
+      return result;
+    }
+
+    auto require_room(stack_heights& h, std::size_t s, std::size_t capacity) -> bool {
+      h[s].hi = std::min(h[s].hi, capacity - 1);
+      return h[s].lo <= h[s].hi;
+    }
+
+    auto require_nonempty(stack_heights& h, std::size_t s) -> bool {
+      h[s].lo = std::max(h[s].lo, static_cast<std::size_t>(1));
+      return h[s].lo <= h[s].hi;
+    }
+
+    auto grow(stack_heights& h, std::size_t s) -> void {
+      ++h[s].lo;
+      ++h[s].hi;
+    }
+
+    auto shrink(stack_heights& h, std::size_t s) -> void {
+      --h[s].lo;
+      --h[s].hi;
+    }
+
+    template <class S>
+    auto transfer(const S& s, std::size_t edge, stack_heights& h, std::size_t capacity) -> bool {
+      auto c = checks_of(s);
+      if (~c.overflow && !require_room(h, c.overflow, capacity))
+        return false;
+      for (auto u : c.underflow)
+        if (~u && !require_nonempty(h, u))
+          return false;
+      if constexpr (std::is_same_v<S, state_pop>)
+        shrink(h, s.target);
+      else if constexpr (std::is_same_v<S, state_move>) {
+        shrink(h, s.from);
+        grow(h, s.target);
+      } else if constexpr (std::is_same_v<S, state_push> || std::is_same_v<S, state_copy> || is_checked_ternary<S> || is_reduction<S>)
+        grow(h, s.target);
+      else if constexpr (std::is_same_v<S, state_empty>) {
+        if (!edge) {
+          if (h[s.target].lo)
+            return false;
+          h[s.target].hi = 0;
+        } else if (!require_nonempty(h, s.target))
+          return false;
+      } else if constexpr (is_bulk_transfer<S>) {
+        if constexpr (std::is_same_v<S, state_bulk_move>)
+          h[s.from].lo = 1;
+        h[s.target].hi = capacity;
+      } else if constexpr (!std::is_same_v<S, state_less> && !is_segment<S>)
+        for (auto& interval : h)
+          interval = {0, capacity};
+      return true;
+    }
+    template <class S>
+    constexpr auto is_arithmetic = is_checked_ternary<S>;
+
+    auto top_of(const known_values& values) -> std::optional<std::uint_least32_t> {
+      return values.empty() ? std::nullopt : values.back();
+    }
+
+    auto push(known_values& values, std::optional<std::uint_least32_t> val) -> void {
+      if (values.size() == known_depth)
+        values.erase(values.begin());
+      values.push_back(val);
+    }
+
+    template <class S>
+    auto fold(const S&, std::uint_least32_t a, std::uint_least32_t b) -> std::optional<std::uint_least32_t> {
+      if constexpr (std::is_same_v<S, state_add>)
+        return static_cast<std::uint_least32_t>((static_cast<std::uint_least64_t>(a) + b) % modulo);
+      else if constexpr (std::is_same_v<S, state_subtract>)
+        return static_cast<std::uint_least32_t>((static_cast<std::uint_least64_t>(modulo) + a - b) % modulo);
+      else if constexpr (std::is_same_v<S, state_multiply>)
+        return static_cast<std::uint_least32_t>(static_cast<std::uint_least64_t>(a) * b % modulo);
+      else if constexpr (std::is_same_v<S, state_divide>)
+        return b ? std::optional{static_cast<std::uint_least32_t>(a / b)} : std::nullopt;
+      else
+        return b ? std::optional{static_cast<std::uint_least32_t>(a % b)} : std::nullopt;
+    }
+
+    template <class S>
+    auto transfer_values(const S& s, std::size_t edge, stack_values& v) -> bool {
+      if constexpr (std::is_same_v<S, state_push>)
+        push(v[s.target], s.val);
+      else if constexpr (std::is_same_v<S, state_pop>) {
+        if (!v[s.target].empty())
+          v[s.target].pop_back();
+      } else if constexpr (std::is_same_v<S, state_move>) {
+        auto val = top_of(v[s.from]);
+        if (!v[s.from].empty())
+          v[s.from].pop_back();
+        push(v[s.target], val);
+      } else if constexpr (std::is_same_v<S, state_copy>)
+        push(v[s.target], top_of(v[s.from]));
+      else if constexpr (is_arithmetic<S>) {
+        auto a = top_of(v[s.left]);
+        auto b = top_of(v[s.right]);
+        push(v[s.target], a && b ? fold(s, *a, *b) : std::nullopt);
+      } else if constexpr (std::is_same_v<S, state_empty>) {
+        if (!edge) {
+          if (!v[s.target].empty())
+            return false;
+        }
+      } else if constexpr (std::is_same_v<S, state_less>) {
+        auto a = top_of(v[s.left]);
+        auto b = top_of(v[s.right]);
+        if (a && b && (*a < *b) != !edge)
+          return false;
+      } else if constexpr (is_segment<S>) {
+        if (!v[s.target].empty())
+          v[s.target].erase(v[s.target].begin(), v[s.target].end() - 1);
+      } else if constexpr (is_reduction<S>)
+        push(v[s.target], std::nullopt);
+      else if constexpr (is_bulk_transfer<S>) {
+        if constexpr (std::is_same_v<S, state_bulk_move>)
+          if (!v[s.from].empty())
+            v[s.from].erase(v[s.from].begin(), v[s.from].end() - 1);
+        v[s.target].clear();
+      } else if constexpr (!std::is_same_v<S, state_terminate>)
+        for (auto& values : v)
+          values.clear();
+      return true;
+    }
+
+    auto join(std::optional<value_range>& a, const value_range& b) -> void {
+      a = a ? value_range{std::min(a->lo, b.lo), std::max(a->hi, b.hi)} : b;
+    }
+
+    auto top_of(const stack_range& r) -> value_range {
+      return !r.known.empty() ? r.known.back() : r.rest.value_or(value_range{});
+    }
+
+    auto hull_of(const stack_range& r) -> std::optional<value_range> {
+      auto result = r.rest;
+      for (const auto& x : r.known)
+        join(result, x);
+      return result;
+    }
+
+    auto push(stack_range& r, const value_range& x) -> void {
+      if (r.known.size() == known_depth) {
+        join(r.rest, r.known.front());
+        r.known.erase(r.known.begin());
+      }
+      r.known.push_back(x);
+    }
+
+    auto pop(stack_range& r) -> void {
+      if (!r.known.empty())
+        r.known.pop_back();
+    }
+
+    template <class S>
+    auto range_of(const S&, const value_range& a, const value_range& b) -> value_range {
+      if constexpr (std::is_same_v<S, state_add>) {
+        if (static_cast<std::uint_least64_t>(a.hi) + b.hi < modulo)
+          return {a.lo + b.lo, a.hi + b.hi};
+      } else if constexpr (std::is_same_v<S, state_subtract>) {
+        if (b.hi <= a.lo)
+          return {a.lo - b.hi, a.hi - b.lo};
+      } else if constexpr (std::is_same_v<S, state_multiply>) {
+        if (static_cast<std::uint_least64_t>(a.hi) * b.hi < modulo)
+          return {a.lo * b.lo, a.hi * b.hi};
+      } else if constexpr (std::is_same_v<S, state_divide>)
+        return {b.hi ? a.lo / b.hi : 0, a.hi / std::max(b.lo, UINT32_C(1))};
+      else {
+        if (a.hi < b.lo)
+          return a;
+        return {0, std::min(a.hi, std::max(b.hi, UINT32_C(1)) - 1)};
+      }
+      return {};
+    }
+
+    template <class S>
+    auto transfer_ranges(const S& s, stack_ranges& r) -> void {
+      if constexpr (std::is_same_v<S, state_push>)
+        push(r[s.target], {s.val, s.val});
+      else if constexpr (std::is_same_v<S, state_pop>)
+        pop(r[s.target]);
+      else if constexpr (std::is_same_v<S, state_move>) {
+        auto x = top_of(r[s.from]);
+        pop(r[s.from]);
+        push(r[s.target], x);
+      } else if constexpr (std::is_same_v<S, state_copy>)
+        push(r[s.target], top_of(r[s.from]));
+      else if constexpr (is_checked_ternary<S>)
+        push(r[s.target], range_of(s, top_of(r[s.left]), top_of(r[s.right])));
+      else if constexpr (is_reduction<S>)
+        push(r[s.target], value_range{});
+      else if constexpr (is_bulk_transfer<S>) {
+        auto hull = hull_of(r[s.target]);
+        if (auto from = hull_of(r[s.from]))
+          join(hull, *from);
+        if constexpr (std::is_same_v<S, state_bulk_move>) {
+          auto k = top_of(r[s.from]);
+          r[s.from] = {{}, hull_of(r[s.from])};
+          push(r[s.from], k);
+        }
+        r[s.target] = {{}, hull};
+      } else if constexpr (is_segment<S>) {
+        auto k = top_of(r[s.target]);
+        auto hull = hull_of(r[s.target]);
+        if constexpr (!is_permutation<S>)
+          join(hull, value_range{});
+        r[s.target] = {{}, hull};
+        push(r[s.target], k);
+      } else if constexpr (!std::is_same_v<S, state_terminate> && !std::is_same_v<S, state_empty> && !std::is_same_v<S, state_less>) {
+        auto clobber = [&](std::size_t i) { r[i] = {{}, value_range{}}; };
+        if constexpr (requires { s.target; })
+          clobber(s.target);
+        if constexpr (requires { s.from; })
+          clobber(s.from);
+        if constexpr (requires { s.count; })
+          clobber(s.count);
+        if constexpr (requires { s.left; })
+          clobber(s.left);
+        if constexpr (requires { s.right; })
+          clobber(s.right);
+      }
+    }
+  }
+
+  auto transfer_heights(const state& s, std::size_t edge, stack_heights& heights, std::size_t capacity) -> bool {
+    return std::visit([&](const auto& s) { return detail::transfer(s, edge, heights, capacity); }, s);
+  }
+
+  auto transfer_values(const state& s, std::size_t edge, stack_values& values) -> bool {
+    return std::visit([&](const auto& s) { return detail::transfer_values(s, edge, values); }, s);
+  }
+
+  auto analyze_stack_heights(const program& prog, std::size_t capacity) -> std::vector<std::optional<stack_heights>> {
+    auto max_stack = static_cast<std::size_t>(0);
+    for (const auto& state : prog.states)
+      std::visit([&](const auto& s) { max_stack = std::max(max_stack, s.max_stack()); }, state);
+    auto init = stack_heights(max_stack + 1, {0, 0});
+    init[0].hi = capacity;
+    auto visits = std::vector<std::size_t>(prog.states.size());
+    return solve_forward(cfg{prog}, std::move(init),
+      [&](std::size_t s, std::size_t edge, const stack_heights& in) -> std::optional<stack_heights> {
+        auto out = in;
+        if (!transfer_heights(prog.states[s], edge, out, capacity))
+          return std::nullopt;
+        return out;
+      },
+      [&](std::size_t s, stack_heights& current, const stack_heights& incoming) {
+        auto changed = false;
+        auto widen = ++visits[s] > detail::widen_after;
+        for (auto i = static_cast<std::size_t>(0); i < current.size(); ++i) {
+          if (incoming[i].lo < current[i].lo) {
+            current[i].lo = widen ? 0 : incoming[i].lo;
+            changed = true;
+          }
+          if (incoming[i].hi > current[i].hi) {
+            current[i].hi = widen ? capacity : incoming[i].hi;
+            changed = true;
+          }
+        }
+        return changed;
+      });
+  }
+
+  auto bounds_check_hints(const program& prog, std::size_t capacity, std::vector<emit_hints>& hints) -> check_stats {
+    auto heights = analyze_stack_heights(prog, capacity);
+    auto n = prog.states.size();
+    auto stats = check_stats{};
+    hints.resize(n);
+    for (auto i = static_cast<std::size_t>(0); i < n; ++i) {
+      auto c = std::visit([](const auto& s) { return detail::checks_of(s); }, prog.states[i]);
+      const auto& h = heights[i];
+      if (~c.overflow) {
+        ++stats.total;
+        if (c.overflow < 8 && (!h || (*h)[c.overflow].hi < capacity)) {
+          hints[i].overflow &= static_cast<std::uint_least8_t>(~(1u << c.overflow));
+          ++stats.removed;
+        }
+      }
+      for (auto u : c.underflow)
+        if (~u) {
+          ++stats.total;
+          if (u < 8 && (!h || (*h)[u].lo)) {
+            hints[i].underflow &= static_cast<std::uint_least8_t>(~(1u << u));
+            ++stats.removed;
+          }
+        }
+    }
+    return stats;
+  }
+
+  auto analyze_constants(const program& prog) -> std::vector<std::optional<stack_values>> {
+    auto max_stack = static_cast<std::size_t>(0);
+    for (const auto& state : prog.states)
+      std::visit([&](const auto& s) { max_stack = std::max(max_stack, s.max_stack()); }, state);
+    return solve_forward(cfg{prog}, stack_values(max_stack + 1),
+      [&](std::size_t s, std::size_t edge, const stack_values& in) -> std::optional<stack_values> {
+        auto out = in;
+        if (!transfer_values(prog.states[s], edge, out))
+          return std::nullopt;
+        return out;
+      },
+      [](std::size_t, stack_values& current, const stack_values& incoming) {
+        auto changed = false;
+        for (auto i = static_cast<std::size_t>(0); i < current.size(); ++i) {
+          auto& a = current[i];
+          const auto& b = incoming[i];
+          if (b.size() < a.size()) {
+            a.erase(a.begin(), a.end() - static_cast<std::ptrdiff_t>(b.size()));
+            changed = true;
+          }
+          for (auto j = static_cast<std::size_t>(0); j < a.size(); ++j) {
+            auto& x = a[a.size() - 1 - j];
+            if (x && x != b[b.size() - 1 - j]) {
+              x = std::nullopt;
+              changed = true;
+            }
+          }
+        }
+        return changed;
+      });
+  }
+
+  auto evaluate(const state& s, const stack_values& values) -> std::optional<std::uint_least32_t> {
+    return std::visit([&](const auto& s) -> std::optional<std::uint_least32_t> {
+      using S = std::decay_t<decltype(s)>;
+      if constexpr (std::is_same_v<S, state_copy>)
+        return detail::top_of(values[s.from]);
+      else if constexpr (detail::is_arithmetic<S>) {
+        auto a = detail::top_of(values[s.left]);
+        auto b = detail::top_of(values[s.right]);
+        return a && b ? detail::fold(s, *a, *b) : std::nullopt;
+      } else
+        return std::nullopt;
+    }, s);
+  }
+
+  auto operand_hints(const program& prog, std::vector<emit_hints>& hints) -> std::size_t {
+    auto values = analyze_constants(prog);
+    auto n = prog.states.size();
+    auto count = static_cast<std::size_t>(0);
+    hints.resize(n);
+    for (auto i = static_cast<std::size_t>(0); i < n; ++i) {
+      if (!values[i])
+        continue;
+      std::visit([&](const auto& s) {
+        using S = std::decay_t<decltype(s)>;
+        if constexpr (detail::is_arithmetic<S> || std::is_same_v<S, state_less>) {
+          hints[i].left = detail::top_of((*values[i])[s.left]);
+          hints[i].right = detail::top_of((*values[i])[s.right]);
+          count += hints[i].left.has_value() + hints[i].right.has_value();
+        }
+      }, prog.states[i]);
+    }
+    return count;
+  }
+
+  auto analyze_ranges(const program& prog) -> std::vector<std::optional<stack_ranges>> {
+    auto max_stack = static_cast<std::size_t>(0);
+    for (const auto& state : prog.states)
+      std::visit([&](const auto& s) { max_stack = std::max(max_stack, s.max_stack()); }, state);
+    auto init = stack_ranges(max_stack + 1);
+    init[0].rest = value_range{};
+    auto visits = std::vector<std::size_t>(prog.states.size());
+    return solve_forward(cfg{prog}, std::move(init),
+      [&](std::size_t s, std::size_t, const stack_ranges& in) -> std::optional<stack_ranges> {
+        auto out = in;
+        std::visit([&](const auto& state) { detail::transfer_ranges(state, out); }, prog.states[s]);
+        return out;
+      },
+      [&](std::size_t s, stack_ranges& current, const stack_ranges& incoming) {
+        auto changed = false;
+        auto widen = ++visits[s] > detail::widen_after;
+        auto join = [&](value_range& a, const value_range& b) {
+          if (b.lo < a.lo) {
+            a.lo = widen ? 0 : b.lo;
+            changed = true;
+          }
+          if (b.hi > a.hi) {
+            a.hi = widen ? modulo - 1 : b.hi;
+            changed = true;
+          }
+        };
+        for (auto i = static_cast<std::size_t>(0); i < current.size(); ++i) {
+          auto& a = current[i];
+          const auto& b = incoming[i];
+          auto common = std::min(a.known.size(), b.known.size());
+          auto rest = b.rest;
+          for (auto j = static_cast<std::size_t>(0); j < b.known.size() - common; ++j)
+            detail::join(rest, b.known[j]);
+          if (a.known.size() > common) {
+            auto extra = a.known.size() - common;
+            for (auto j = static_cast<std::size_t>(0); j < extra; ++j)
+              detail::join(a.rest, a.known[j]);
+            a.known.erase(a.known.begin(), a.known.begin() + static_cast<std::ptrdiff_t>(extra));
+            changed = true;
+          }
+          for (auto j = static_cast<std::size_t>(0); j < common; ++j)
+            join(a.known[j], b.known[b.known.size() - common + j]);
+          if (rest) {
+            if (!a.rest) {
+              a.rest = rest;
+              changed = true;
+            } else
+              join(*a.rest, *rest);
+          }
+        }
+        return changed;
+      });
+  }
+
+  auto range_hints(const program& prog, std::vector<emit_hints>& hints) -> std::size_t {
+    auto ranges = analyze_ranges(prog);
+    auto n = prog.states.size();
+    auto count = static_cast<std::size_t>(0);
+    hints.resize(n);
+    for (auto i = static_cast<std::size_t>(0); i < n; ++i) {
+      if (!ranges[i])
+        continue;
+      std::visit([&](const auto& s) {
+        using S = std::decay_t<decltype(s)>;
+        if constexpr (detail::is_arithmetic<S>) {
+          hints[i].left_range = detail::top_of((*ranges[i])[s.left]);
+          hints[i].right_range = detail::top_of((*ranges[i])[s.right]);
+          count += (hints[i].left_range.lo || hints[i].left_range.hi < modulo - 1) + (hints[i].right_range.lo || hints[i].right_range.hi < modulo - 1);
+        }
+      }, prog.states[i]);
+    }
+    return count;
+  }
+
+  auto fusion_chains(const program& prog, const std::vector<emit_hints>& hints, std::vector<std::size_t>& fused) -> std::size_t {
+    auto g = cfg{prog};
+    auto n = prog.states.size();
+    auto count = static_cast<std::size_t>(0);
+    auto linked = std::vector<bool>(n);
+    fused.assign(n, -1);
+    for (auto i = static_cast<std::size_t>(0); i < n; ++i)
+      std::visit([&](const auto& s) {
+        using S = std::decay_t<decltype(s)>;
+        if constexpr (detail::is_fusable<S>) {
+          if constexpr (std::is_same_v<S, state_divide> || std::is_same_v<S, state_modulo>)
+            if (i >= hints.size() || hints[i].check_divisor())
+              return;
+          if (s.next == prog.init || g.predecessors(s.next).size() != 1)
+            return;
+          if (!std::visit([](const auto& t) { return detail::is_fusable<std::decay_t<decltype(t)>> || detail::ends_fusion<std::decay_t<decltype(t)>>; }, prog.states[s.next]))
+            return;
+          fused[i] = s.next;
+          linked[s.next] = true;
+          ++count;
+        }
+      }, prog.states[i]);
+    auto seen = std::vector<bool>(n);
+    auto walk = [&](std::size_t i) {
+      for (; ~i && !seen[i]; i = fused[i])
+        seen[i] = true;
+    };
+    for (auto i = static_cast<std::size_t>(0); i < n; ++i)
+      if (!linked[i])
+        walk(i);
+    for (auto i = static_cast<std::size_t>(0); i < n; ++i)
+      if (!seen[i]) {
+        fused[g.predecessors(i)[0]] = -1;
+        --count;
+        walk(i);
+      }
+    return count;
+  }
+
+  auto recognize_loop_idioms(const program& prog, std::vector<loop_idiom>& idioms) -> std::size_t {
+    auto count = static_cast<std::size_t>(0);
+    idioms.assign(prog.states.size(), {});
+    for (auto h = static_cast<std::size_t>(0); h < prog.states.size(); ++h) {
+      auto head = std::get_if<state_empty>(&prog.states[h]);
+      if (!head)
+        continue;
+      auto body = std::vector<const state*>{};
+      for (auto i = head->alternative; i != h;) {
+        if (body.size() == 2 || !~i) {
+          body.clear();
+          break;
+        }
+        body.push_back(&prog.states[i]);
+        i = std::visit([](const auto& s) -> std::size_t {
+          if constexpr (requires { s.next; })
+            return s.next;
+          else
+            return -1;
+        }, prog.states[i]);
+      }
+      if (body.empty())
+        continue;
+      auto x = head->target;
+      auto move = body.size() == 1 ? std::get_if<state_move>(body[0]) : nullptr;
+      auto copy = body.size() == 2 ? std::get_if<state_copy>(body[0]) : nullptr;
+      auto pop = std::get_if<state_pop>(body[0]);
+      auto pop_last = body.size() == 2 ? std::get_if<state_pop>(body[1]) : nullptr;
+      auto push = body.size() == 2 ? std::get_if<state_push>(body[pop ? 1 : 0]) : nullptr;
+      auto popped = pop ? pop : pop_last;
+      if (move && move->from == x && move->target != x)
+        idioms[h] = loop_drain{move->target};
+      else if (copy && copy->from == x && copy->target != x && pop_last && pop_last->target == x)
+        idioms[h] = loop_drain{copy->target};
+      else if (body.size() == 1 && pop && pop->target == x)
+        idioms[h] = loop_clear{};
+      else if (push && push->target != x && popped && popped->target == x)
+        idioms[h] = loop_fill{push->target, push->val};
+      else
+        continue;
+      ++count;
+    }
+    return count;
+  }
+}
@@ -0,0 +1,47 @@
+#ifndef LUOGU3_ANALYSIS_HPP
+#define LUOGU3_ANALYSIS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <luogu3/program.hpp>
+#include <optional>
+#include <vector>
+
+namespace ud2::luogu3 {
+  struct height_interval {
+    std::size_t lo;
+    std::size_t hi;
+  };
+
+  using stack_heights = std::vector<height_interval>;
+  using known_values = std::vector<std::optional<std::uint_least32_t>>;
+  using stack_values = std::vector<known_values>;
+
+  struct stack_range {
+    std::vector<value_range> known;
+    std::optional<value_range> rest;
+  };
+
+  using stack_ranges = std::vector<stack_range>;
+
+  constexpr auto known_depth = static_cast<std::size_t>(4);
+
+  struct check_stats {
+    std::size_t total = 0;
+    std::size_t removed = 0;
+  };
+
+  auto transfer_heights(const state& s, std::size_t edge, stack_heights& heights, std::size_t capacity) -> bool;
+  auto transfer_values(const state& s, std::size_t edge, stack_values& values) -> bool;
+  auto analyze_stack_heights(const program& prog, std::size_t capacity) -> std::vector<std::optional<stack_heights>>;
+  auto bounds_check_hints(const program& prog, std::size_t capacity, std::vector<emit_hints>& hints) -> check_stats;
+  auto analyze_constants(const program& prog) -> std::vector<std::optional<stack_values>>;
+  auto evaluate(const state& s, const stack_values& values) -> std::optional<std::uint_least32_t>;
+  auto operand_hints(const program& prog, std::vector<emit_hints>& hints) -> std::size_t;
+  auto analyze_ranges(const program& prog) -> std::vector<std::optional<stack_ranges>>;
+  auto range_hints(const program& prog, std::vector<emit_hints>& hints) -> std::size_t;
+  auto fusion_chains(const program& prog, const std::vector<emit_hints>& hints, std::vector<std::size_t>& fused) -> std::size_t;
+  auto recognize_loop_idioms(const program& prog, std::vector<loop_idiom>& idioms) -> std::size_t;
+}
+
+#endif
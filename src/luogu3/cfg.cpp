@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <luogu3/cfg.hpp>
+#include <utility>
+
+namespace ud2::luogu3 {
+  namespace detail {
+    auto intersect(const std::vector<std::size_t>& idom, const std::vector<std::size_t>& rank, std::size_t a, std::size_t b) -> std::size_t {
+      while (a != b) {
+        while (rank[a] > rank[b])
+          a = idom[a];
+        while (rank[b] > rank[a])
+          b = idom[b];
+      }
+      return a;
+    }
+  }
+
+  cfg::cfg(const program& prog) : entry{prog.init} {
+    auto n = prog.states.size();
+    this->succ_index.reserve(n + 1);
+    this->succ_index.push_back(0);
+    auto in_degree = std::vector<std::size_t>(n + 1);
+    for (const auto& state : prog.states) {
+      for_each_successor(state, [&](std::size_t next) {
+        this->succ_list.push_back(next);
+        ++in_degree[next + 1];
+      });
+      this->succ_index.push_back(this->succ_list.size());
+    }
+    for (auto i = static_cast<std::size_t>(0); i < n; ++i)
+      in_degree[i + 1] += in_degree[i];
+    this->pred_index = in_degree;
+    this->pred_list.resize(this->succ_list.size());
+    for (auto i = static_cast<std::size_t>(0); i < n; ++i)
+      for (auto next : this->successors(i))
+        this->pred_list[in_degree[next]++] = i;
+  }
+
+  auto cfg::size() const -> std::size_t {
+    return this->succ_index.size() - 1;
+  }
+
+  auto cfg::successors(std::size_t s) const -> std::span<const std::size_t> {
+    return {this->succ_list.data() + this->succ_index[s], this->succ_list.data() + this->succ_index[s + 1]};
+  }
+
+  auto cfg::predecessors(std::size_t s) const -> std::span<const std::size_t> {
+    return {this->pred_list.data() + this->pred_index[s], this->pred_list.data() + this->pred_index[s + 1]};
+  }
+
+  auto reverse_postorder(const cfg& g) -> std::vector<std::size_t> {
+    auto n = g.size();
+    auto order = std::vector<std::size_t>{};
+    if (!n)
+      return order;
+    auto visited = std::vector<bool>(n);
+    auto stack = std::vector<std::pair<std::size_t, std::size_t>>{{g.entry, 0}};
+    visited[g.entry] = true;
+    while (!stack.empty()) {
+      auto& [s, i] = stack.back();
+      auto succs = g.successors(s);
+      if (i == succs.size()) {
+        order.push_back(s);
+        stack.pop_back();
+        continue;
+      }
+      auto next = succs[i++];
+      if (!visited[next]) {
+        visited[next] = true;
+        stack.emplace_back(next, 0);
+      }
+    }
+    std::reverse(order.begin(), order.end());
+    return order;
+  }
+
+  auto reachable(const cfg& g) -> std::vector<bool> {
+    auto n = g.size();
+    auto result = std::vector<bool>(n);
+    if (!n)
+      return result;
+    auto work = std::vector<std::size_t>{g.entry};
+    result[g.entry] = true;
+    while (!work.empty()) {
+      auto s = work.back();
+      work.pop_back();
+      for (auto next : g.successors(s))
+        if (!result[next]) {
+          result[next] = true;
+          work.push_back(next);
+        }
+    }
+    return result;
+  }
+
+  auto strongly_connected_components(const cfg& g) -> scc_result {
+    auto n = g.size();
+    auto result = scc_result{std::vector<std::size_t>(n, -1), 0};
+    auto index = std::vector<std::size_t>(n, -1);
+    auto low = std::vector<std::size_t>(n);
+    auto on_stack = std::vector<bool>(n);
+    auto stack = std::vector<std::size_t>{};
+    auto calls = std::vector<std::pair<std::size_t, std::size_t>>{};
+    auto counter = static_cast<std::size_t>(0);
+    for (auto root = static_cast<std::size_t>(0); root < n; ++root) {
+      if (~index[root])
+        continue;
+      calls.emplace_back(root, 0);
+      while (!calls.empty()) {
+        auto& [s, i] = calls.back();
+        if (!i) {
+          index[s] = low[s] = counter++;
+          stack.push_back(s);
+          on_stack[s] = true;
+        }
+        auto succs = g.successors(s);
+        if (i < succs.size()) {
+          auto next = succs[i++];
+          if (!~index[next])
+            calls.emplace_back(next, 0);
+          else if (on_stack[next])
+            low[s] = std::min(low[s], index[next]);
+          continue;
+        }
+        auto v = s;
+        calls.pop_back();
+        if (!calls.empty())
+          low[calls.back().first] = std::min(low[calls.back().first], low[v]);
+        if (low[v] == index[v]) {
+          for (;;) {
+            auto w = stack.back();
+            stack.pop_back();
+            on_stack[w] = false;
+            result.component[w] = result.count;
+            if (w == v)
+              break;
+          }
+          ++result.count;
+        }
+      }
+    }
+    return result;
+  }
+
+  auto dominators(const cfg& g) -> std::vector<std::size_t> {
+    auto n = g.size();
+    auto idom = std::vector<std::size_t>(n, -1);
+    if (!n)
+      return idom;
+    auto order = reverse_postorder(g);
+    auto rank = std::vector<std::size_t>(n, -1);
+    for (auto i = static_cast<std::size_t>(0); i < order.size(); ++i)
+      rank[order[i]] = i;
+    idom[g.entry] = g.entry;
+    for (auto changed = true; changed;) {
+      changed = false;
+      for (auto i = static_cast<std::size_t>(1); i < order.size(); ++i) {
+        auto s = order[i];
+        auto result = static_cast<std::size_t>(-1);
+        for (auto pred : g.predecessors(s))
+          if (~idom[pred])
+            result = ~result ? detail::intersect(idom, rank, pred, result) : pred;
+        if (result != idom[s]) {
+          idom[s] = result;
+          changed = true;
+        }
+      }
+    }
+    return idom;
+  }
+
+  auto dominates(const std::vector<std::size_t>& idom, std::size_t a, std::size_t b) -> bool {
+    if (!~idom[a] || !~idom[b])
+      return false;
+    for (;;) {
+      if (a == b)
+        return true;
+      if (idom[b] == b)
+        return false;
+      b = idom[b];
+    }
+  }
+}
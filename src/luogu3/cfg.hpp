@@ -0,0 +1,90 @@
+#ifndef LUOGU3_CFG_HPP
+#define LUOGU3_CFG_HPP
+
+#include <cstddef>
+#include <functional>
+#include <luogu3/program.hpp>
+#include <optional>
+#include <queue>
+#include <span>
+#include <variant>
+#include <vector>
+
+namespace ud2::luogu3 {
+  template <class State, class F>
+  auto for_each_successor(State& state, F f) -> void {
+    std::visit([&](auto& s) {
+      if constexpr (requires { s.next; })
+        f(s.next);
+      if constexpr (requires { s.consequent; }) {
+        f(s.consequent);
+        f(s.alternative);
+      }
+    }, state);
+  }
+
+  struct cfg {
+    std::size_t entry = 0;
+    std::vector<std::size_t> succ_index;
+    std::vector<std::size_t> succ_list;
+    std::vector<std::size_t> pred_index;
+    std::vector<std::size_t> pred_list;
+    explicit cfg(const program& prog);
+    auto size() const -> std::size_t;
+    auto successors(std::size_t s) const -> std::span<const std::size_t>;
+    auto predecessors(std::size_t s) const -> std::span<const std::size_t>;
+  };
+
+  struct scc_result {
+    std::vector<std::size_t> component;
+    std::size_t count = 0;
+  };
+
+  auto reverse_postorder(const cfg& g) -> std::vector<std::size_t>;
+  auto reachable(const cfg& g) -> std::vector<bool>;
+  auto strongly_connected_components(const cfg& g) -> scc_result;
+  auto dominators(const cfg& g) -> std::vector<std::size_t>;
+  auto dominates(const std::vector<std::size_t>& idom, std::size_t a, std::size_t b) -> bool;
+
+  template <class T, class Transfer, class Join>
+  auto solve_forward(const cfg& g, T init, Transfer transfer, Join join) -> std::vector<std::optional<T>> {
+    auto n = g.size();
+    auto result = std::vector<std::optional<T>>(n);
+    if (!n)
+      return result;
+    auto order = reverse_postorder(g);
+    auto rank = std::vector<std::size_t>(n, -1);
+    for (auto i = static_cast<std::size_t>(0); i < order.size(); ++i)
+      rank[order[i]] = i;
+    auto queued = std::vector<bool>(n);
+    auto work = std::priority_queue<std::size_t, std::vector<std::size_t>, std::greater<>>{};
+    result[g.entry] = std::move(init);
+    queued[g.entry] = true;
+    work.push(rank[g.entry]);
+    while (!work.empty()) {
+      auto s = order[work.top()];
+      work.pop();
+      queued[s] = false;
+      auto succs = g.successors(s);
+      for (auto j = static_cast<std::size_t>(0); j < succs.size(); ++j) {
+        auto t = succs[j];
+        auto out = std::optional<T>{transfer(s, j, *result[s])};
+        if (!out)
+          continue;
+        auto changed = false;
+        if (!result[t]) {
+          result[t] = std::move(*out);
+          changed = true;
+        } else
+          changed = join(t, *result[t], *out);
+        if (changed && !queued[t]) {
+          queued[t] = true;
+          work.push(rank[t]);
+        }
+      }
+    }
+    return result;
+  }
+}
+
+#endif
@@ -1,11 +1,14 @@
+#include <algorithm>
 #include <charconv>
+#include <cstdint>
+#include <cstring>
 #include <functional>
-#include <iomanip>
-#include <iostream>
 #include <luogu3/compile.hpp>
 #include <optional>
+#include <stdexcept>
 #include <system_error>
-#include <unordered_map>
+#include <thread>
+#include <utility>
 
 namespace ud2::luogu3 {
   namespace detail {
@@ -17,38 +20,34 @@ namespace ud2::luogu3 {
       return is_space(ch) || ch == '\n';
     }
 
-    auto skip_space(const char*& ptr) -> void {
-      while (is_space(*ptr))
+    auto skip_space(const char*& ptr, const char* end) -> void {
+      while (ptr != end && is_space(*ptr))
         ++ptr;
     }
 
-    auto skip_separator(const char*& ptr) -> void {
-      while (is_separator(*ptr))
+    auto skip_separator(const char*& ptr, const char* end) -> void {
+      while (ptr != end && is_separator(*ptr))
         ++ptr;
     }
 
-    auto skip_line(const char*& ptr) -> void {
-      while (*ptr && *ptr++ != '\n') {}
-    }
-
-    auto expect_space(compile_result& result, const char*& ptr, const char* start) -> bool {
-      if (*ptr && !is_separator(*ptr)) {
-        result.diags.push_back({
+    auto expect_space(std::vector<diagnostic>& diags, const char*& ptr, const char* start, const char* end) -> bool {
+      if (ptr != end && !is_separator(*ptr)) {
+        diags.push_back({
           static_cast<std::size_t>(ptr - start),
           static_cast<std::size_t>(ptr - start),
           "expected whitespace",
         });
         return false;
       }
-      skip_space(ptr);
+      skip_space(ptr, end);
       return true;
     }
 
-    auto expect_newline(compile_result& result, const char*& ptr, const char* start) -> bool {
-      skip_space(ptr);
-      if (*ptr) {
+    auto expect_newline(std::vector<diagnostic>& diags, const char*& ptr, const char* start, const char* end) -> bool {
+      skip_space(ptr, end);
+      if (ptr != end) {
         if (*ptr != '\n') {
-          result.diags.push_back({
+          diags.push_back({
             static_cast<std::size_t>(ptr - start),
             static_cast<std::size_t>(ptr - start),
             "expected newline",
@@ -60,10 +59,10 @@ namespace ud2::luogu3 {
       return true;
     }
 
-    auto expect_eof(compile_result& result, const char*& ptr, const char* start) -> bool {
-      skip_separator(ptr);
-      if (*ptr) {
-        result.diags.push_back({
+    auto expect_eof(std::vector<diagnostic>& diags, const char*& ptr, const char* start, const char* end) -> bool {
+      skip_separator(ptr, end);
+      if (ptr != end) {
+        diags.push_back({
           static_cast<std::size_t>(ptr - start),
           static_cast<std::size_t>(ptr - start),
           "expected end of file",
@@ -73,27 +72,21 @@ namespace ud2::luogu3 {
       return true;
     }
 
-    auto expect_stack(compile_result& result, const char*& ptr, const char* start) -> std::optional<std::size_t> {
-      static const auto stacks = std::unordered_map<std::string, std::size_t>{
-        {"A", 0},
-        {"B", 1},
-        {"C", 2},
-      };
+    auto expect_stack(std::vector<diagnostic>& diags, const char*& ptr, const char* start, const char* end) -> std::optional<std::size_t> {
       auto begin = ptr;
-      while (*ptr && !is_separator(*ptr))
+      while (ptr != end && !is_separator(*ptr))
         ++ptr;
       if (begin == ptr) {
-        result.diags.push_back({
+        diags.push_back({
           static_cast<std::size_t>(ptr - start),
           static_cast<std::size_t>(ptr - start),
           "expected stack name",
         });
         return std::nullopt;
       }
-      auto s = std::string{begin, ptr};
-      if (auto fn = stacks.find(s); fn != stacks.end())
-        return fn->second;
-      result.diags.push_back({
+      if (ptr - begin == 1 && *begin >= 'A' && *begin <= 'C')
+        return static_cast<std::size_t>(*begin - 'A');
+      diags.push_back({
         static_cast<std::size_t>(begin - start),
         static_cast<std::size_t>(ptr - start),
         "unknown stack name",
@@ -101,11 +94,11 @@ namespace ud2::luogu3 {
       return std::nullopt;
     }
 
-    auto expect_state(compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::size_t {
+    auto expect_state(std::vector<diagnostic>& diags, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::size_t {
       std::size_t state;
       auto conv = std::from_chars(ptr, end, state);
       if (conv.ec == std::errc::invalid_argument) {
-        result.diags.push_back({
+        diags.push_back({
           static_cast<std::size_t>(ptr - start),
           static_cast<std::size_t>(ptr - start),
           "invalid integer",
@@ -113,7 +106,7 @@ namespace ud2::luogu3 {
         return -1;
       }
       if (conv.ec == std::errc::result_out_of_range) {
-        result.diags.push_back({
+        diags.push_back({
           static_cast<std::size_t>(ptr - start),
           static_cast<std::size_t>(conv.ptr - start),
           "invalid state",
@@ -121,7 +114,7 @@ namespace ud2::luogu3 {
         return -1;
       }
       if (state > n) {
-        result.diags.push_back({
+        diags.push_back({
           static_cast<std::size_t>(ptr - start),
           static_cast<std::size_t>(conv.ptr - start),
           "state out of bounds",
@@ -129,7 +122,7 @@ namespace ud2::luogu3 {
         return -1;
       }
       if (state == 0) {
-        result.diags.push_back({
+        diags.push_back({
           static_cast<std::size_t>(ptr - start),
           static_cast<std::size_t>(conv.ptr - start),
           "invalid state; did you mean state 1?",
@@ -140,664 +133,422 @@ namespace ud2::luogu3 {
       return --state;
     }
 
-    auto parse_line(compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-      static const auto states = std::unordered_map<std::string, std::function<std::optional<state>(compile_result & result, std::size_t n, const char*& ptr, const char* start, const char* end)>>{
-        {
-          "TER",
-          [](compile_result& result, std::size_t, const char*& ptr, const char* start, const char*) -> std::optional<state> {
-            if (!expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_terminate{};
-          },
-        },
-        {
-          "PUS",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            std::uint_least32_t val;
-            {
-              auto conv = std::from_chars(ptr, end, val);
-              if (conv.ec == std::errc::invalid_argument) {
-                result.diags.push_back({
-                  static_cast<std::size_t>(ptr - start),
-                  static_cast<std::size_t>(ptr - start),
-                  "invalid integer",
-                });
-                return std::nullopt;
-              }
-              if (val >= modulo) {
-                result.diags.push_back({
-                  static_cast<std::size_t>(ptr - start),
-                  static_cast<std::size_t>(conv.ptr - start),
-                  "value out of bounds",
-                });
-                return std::nullopt;
-              }
-              ptr = conv.ptr;
-            }
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto next = expect_state(result, n, ptr, start, end);
-            if (!~next || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_push{*target, val, next};
-          },
-        },
-        {
-          "POP",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto next = expect_state(result, n, ptr, start, end);
-            if (!~next || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_pop{*target, next};
-          },
-        },
-        {
-          "MOV",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto from = expect_stack(result, ptr, start);
-            if (!from || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto next = expect_state(result, n, ptr, start, end);
-            if (!~next || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_move{*target, *from, next};
-          },
-        },
-        {
-          "CPY",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto from = expect_stack(result, ptr, start);
-            if (!from || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto next = expect_state(result, n, ptr, start, end);
-            if (!~next || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_copy{*target, *from, next};
-          },
-        },
-        {
-          "ADD",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto left = expect_stack(result, ptr, start);
-            if (!left || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto right = expect_stack(result, ptr, start);
-            if (!right || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto next = expect_state(result, n, ptr, start, end);
-            if (!~next || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_add{*target, *left, *right, next};
-          },
-        },
-        {
-          "SUB",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto left = expect_stack(result, ptr, start);
-            if (!left || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto right = expect_stack(result, ptr, start);
-            if (!right || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto next = expect_state(result, n, ptr, start, end);
-            if (!~next || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_subtract{*target, *left, *right, next};
-          },
-        },
-        {
-          "MUL",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto left = expect_stack(result, ptr, start);
-            if (!left || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto right = expect_stack(result, ptr, start);
-            if (!right || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto next = expect_state(result, n, ptr, start, end);
-            if (!~next || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_multiply{*target, *left, *right, next};
-          },
-        },
-        {
-          "DIV",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto left = expect_stack(result, ptr, start);
-            if (!left || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto right = expect_stack(result, ptr, start);
-            if (!right || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto next = expect_state(result, n, ptr, start, end);
-            if (!~next || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_divide{*target, *left, *right, next};
-          },
-        },
-        {
-          "MOD",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto left = expect_stack(result, ptr, start);
-            if (!left || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto right = expect_stack(result, ptr, start);
-            if (!right || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto next = expect_state(result, n, ptr, start, end);
-            if (!~next || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_modulo{*target, *left, *right, next};
-          },
-        },
-        {
-          "EMP",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto consequent = expect_state(result, n, ptr, start, end);
-            if (!~consequent || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto alternative = expect_state(result, n, ptr, start, end);
-            if (!~alternative || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_empty{*target, consequent, alternative};
-          },
-        },
-        {
-          "CMP",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto right = expect_stack(result, ptr, start);
-            if (!right || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto left = expect_stack(result, ptr, start);
-            if (!left || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto alternative = expect_state(result, n, ptr, start, end);
-            if (!~alternative || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto consequent = expect_state(result, n, ptr, start, end);
-            if (!~consequent || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_less{*left, *right, consequent, alternative};
-          },
-        },
-        {
-          "T00",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto next = expect_state(result, n, ptr, start, end);
-            if (!~next || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_prefix_sum{*target, next};
-          },
-        },
-        {
-          "T01",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto next = expect_state(result, n, ptr, start, end);
-            if (!~next || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_suffix_sum{*target, next};
-          },
-        },
-        {
-          "T02",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto next = expect_state(result, n, ptr, start, end);
-            if (!~next || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_finite_difference{*target, next};
-          },
-        },
-        {
-          "T03",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto next = expect_state(result, n, ptr, start, end);
-            if (!~next || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_reverse{*target, next};
-          },
-        },
-        {
-          "T04",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto next = expect_state(result, n, ptr, start, end);
-            if (!~next || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_sort_ascending{*target, next};
-          },
-        },
-        {
-          "T05",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto next = expect_state(result, n, ptr, start, end);
-            if (!~next || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_sort_descending{*target, next};
-          },
-        },
-        {
-          "T06",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto count = expect_stack(result, ptr, start);
-            if (!count || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto next = expect_state(result, n, ptr, start, end);
-            if (!~next || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_rotate{*target, *count, next};
-          },
-        },
-        {
-          "T07",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto from = expect_stack(result, ptr, start);
-            if (!from || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto next = expect_state(result, n, ptr, start, end);
-            if (!~next || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_bulk_move{*target, *from, next};
-          },
-        },
-        {
-          "T08",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto from = expect_stack(result, ptr, start);
-            if (!from || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto next = expect_state(result, n, ptr, start, end);
-            if (!~next || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_bulk_copy{*target, *from, next};
-          },
-        },
-        {
-          "T09",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto from = expect_stack(result, ptr, start);
-            if (!from || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto next = expect_state(result, n, ptr, start, end);
-            if (!~next || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_fill{*target, *from, next};
-          },
-        },
-        {
-          "T10",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto from = expect_stack(result, ptr, start);
-            if (!from || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto next = expect_state(result, n, ptr, start, end);
-            if (!~next || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_iota{*target, *from, next};
-          },
-        },
-        {
-          "T11",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto from = expect_stack(result, ptr, start);
-            if (!from || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto next = expect_state(result, n, ptr, start, end);
-            if (!~next || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_sum{*target, *from, next};
-          },
-        },
-        {
-          "T12",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto from = expect_stack(result, ptr, start);
-            if (!from || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto next = expect_state(result, n, ptr, start, end);
-            if (!~next || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_product{*target, *from, next};
-          },
-        },
-        // T13 does not exist
-        {
-          "T14",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto from = expect_stack(result, ptr, start);
-            if (!from || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto next = expect_state(result, n, ptr, start, end);
-            if (!~next || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_bulk_add{*target, *from, next};
-          },
-        },
-        {
-          "T15",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto from = expect_stack(result, ptr, start);
-            if (!from || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto next = expect_state(result, n, ptr, start, end);
-            if (!~next || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_bulk_subtract{*target, *from, next};
-          },
-        },
-        {
-          "T16",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto from = expect_stack(result, ptr, start);
-            if (!from || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto next = expect_state(result, n, ptr, start, end);
-            if (!~next || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_bulk_multiply{*target, *from, next};
-          },
-        },
-        {
-          "T17",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto from = expect_stack(result, ptr, start);
-            if (!from || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto next = expect_state(result, n, ptr, start, end);
-            if (!~next || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_bulk_divide{*target, *from, next};
-          },
-        },
-        {
-          "T18",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto from = expect_stack(result, ptr, start);
-            if (!from || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto next = expect_state(result, n, ptr, start, end);
-            if (!~next || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_bulk_modulo{*target, *from, next};
-          },
-        },
-        {
-          "T19",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto left = expect_stack(result, ptr, start);
-            if (!left || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto right = expect_stack(result, ptr, start);
-            if (!right || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto next = expect_state(result, n, ptr, start, end);
-            if (!~next || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_vector_add{*target, *left, *right, next};
-          },
-        },
-        {
-          "T20",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto left = expect_stack(result, ptr, start);
-            if (!left || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto right = expect_stack(result, ptr, start);
-            if (!right || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto next = expect_state(result, n, ptr, start, end);
-            if (!~next || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_vector_subtract{*target, *left, *right, next};
-          },
-        },
-        {
-          "T21",
-          [](compile_result& result, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
-            if (!expect_space(result, ptr, start))
-              return std::nullopt;
-            auto target = expect_stack(result, ptr, start);
-            if (!target || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto left = expect_stack(result, ptr, start);
-            if (!left || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto right = expect_stack(result, ptr, start);
-            if (!right || !expect_space(result, ptr, start))
-              return std::nullopt;
-            auto next = expect_state(result, n, ptr, start, end);
-            if (!~next || !expect_newline(result, ptr, start))
-              return std::nullopt;
-            return state_vector_multiply{*target, *left, *right, next};
-          },
-        },
-      };
+    auto parse_terminate(std::vector<diagnostic>& diags, std::size_t, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
+      if (!expect_newline(diags, ptr, start, end))
+        return std::nullopt;
+      return state_terminate{};
+    }
+
+    auto parse_push(std::vector<diagnostic>& diags, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
+      if (!expect_space(diags, ptr, start, end))
+        return std::nullopt;
+      auto target = expect_stack(diags, ptr, start, end);
+      if (!target || !expect_space(diags, ptr, start, end))
+        return std::nullopt;
+      std::uint_least32_t val;
+      {
+        auto conv = std::from_chars(ptr, end, val);
+        if (conv.ec == std::errc::invalid_argument) {
+          diags.push_back({
+            static_cast<std::size_t>(ptr - start),
+            static_cast<std::size_t>(ptr - start),
+            "invalid integer",
+          });
+          return std::nullopt;
+        }
+        if (conv.ec == std::errc::result_out_of_range || val >= modulo) {
+          diags.push_back({
+            static_cast<std::size_t>(ptr - start),
+            static_cast<std::size_t>(conv.ptr - start),
+            "value out of bounds",
+          });
+          return std::nullopt;
+        }
+        ptr = conv.ptr;
+      }
+      if (!expect_space(diags, ptr, start, end))
+        return std::nullopt;
+      auto next = expect_state(diags, n, ptr, start, end);
+      if (!~next || !expect_newline(diags, ptr, start, end))
+        return std::nullopt;
+      return state_push{*target, val, next};
+    }
+
+    auto parse_empty(std::vector<diagnostic>& diags, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
+      if (!expect_space(diags, ptr, start, end))
+        return std::nullopt;
+      auto target = expect_stack(diags, ptr, start, end);
+      if (!target || !expect_space(diags, ptr, start, end))
+        return std::nullopt;
+      auto consequent = expect_state(diags, n, ptr, start, end);
+      if (!~consequent || !expect_space(diags, ptr, start, end))
+        return std::nullopt;
+      auto alternative = expect_state(diags, n, ptr, start, end);
+      if (!~alternative || !expect_newline(diags, ptr, start, end))
+        return std::nullopt;
+      return state_empty{*target, consequent, alternative};
+    }
+
+    auto parse_less(std::vector<diagnostic>& diags, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
+      if (!expect_space(diags, ptr, start, end))
+        return std::nullopt;
+      auto right = expect_stack(diags, ptr, start, end);
+      if (!right || !expect_space(diags, ptr, start, end))
+        return std::nullopt;
+      auto left = expect_stack(diags, ptr, start, end);
+      if (!left || !expect_space(diags, ptr, start, end))
+        return std::nullopt;
+      auto alternative = expect_state(diags, n, ptr, start, end);
+      if (!~alternative || !expect_space(diags, ptr, start, end))
+        return std::nullopt;
+      auto consequent = expect_state(diags, n, ptr, start, end);
+      if (!~consequent || !expect_newline(diags, ptr, start, end))
+        return std::nullopt;
+      return state_less{*left, *right, consequent, alternative};
+    }
+
+    template <class S>
+    auto parse_unary(std::vector<diagnostic>& diags, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
+      if (!expect_space(diags, ptr, start, end))
+        return std::nullopt;
+      auto target = expect_stack(diags, ptr, start, end);
+      if (!target || !expect_space(diags, ptr, start, end))
+        return std::nullopt;
+      auto next = expect_state(diags, n, ptr, start, end);
+      if (!~next || !expect_newline(diags, ptr, start, end))
+        return std::nullopt;
+      return S{*target, next};
+    }
+
+    template <class S>
+    auto parse_binary(std::vector<diagnostic>& diags, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
+      if (!expect_space(diags, ptr, start, end))
+        return std::nullopt;
+      auto target = expect_stack(diags, ptr, start, end);
+      if (!target || !expect_space(diags, ptr, start, end))
+        return std::nullopt;
+      auto from = expect_stack(diags, ptr, start, end);
+      if (!from || !expect_space(diags, ptr, start, end))
+        return std::nullopt;
+      auto next = expect_state(diags, n, ptr, start, end);
+      if (!~next || !expect_newline(diags, ptr, start, end))
+        return std::nullopt;
+      return S{*target, *from, next};
+    }
+
+    template <class S>
+    auto parse_ternary(std::vector<diagnostic>& diags, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
+      if (!expect_space(diags, ptr, start, end))
+        return std::nullopt;
+      auto target = expect_stack(diags, ptr, start, end);
+      if (!target || !expect_space(diags, ptr, start, end))
+        return std::nullopt;
+      auto left = expect_stack(diags, ptr, start, end);
+      if (!left || !expect_space(diags, ptr, start, end))
+        return std::nullopt;
+      auto right = expect_stack(diags, ptr, start, end);
+      if (!right || !expect_space(diags, ptr, start, end))
+        return std::nullopt;
+      auto next = expect_state(diags, n, ptr, start, end);
+      if (!~next || !expect_newline(diags, ptr, start, end))
+        return std::nullopt;
+      return S{*target, *left, *right, next};
+    }
+
+    constexpr auto mnemonic(const char* s) noexcept -> std::uint_least32_t {
+      return static_cast<std::uint_least32_t>(static_cast<unsigned char>(s[0]))
+        | static_cast<std::uint_least32_t>(static_cast<unsigned char>(s[1])) << 8
+        | static_cast<std::uint_least32_t>(static_cast<unsigned char>(s[2])) << 16;
+    }
+
+    auto parse_line(std::vector<diagnostic>& diags, std::size_t n, const char*& ptr, const char* start, const char* end) -> std::optional<state> {
       auto begin = ptr;
-      while (*ptr && !is_separator(*ptr))
+      while (ptr != end && !is_separator(*ptr))
         ++ptr;
       if (begin == ptr) {
-        result.diags.push_back({
+        diags.push_back({
           static_cast<std::size_t>(ptr - start),
           static_cast<std::size_t>(ptr - start),
           "expected state type",
         });
         return std::nullopt;
       }
-      auto s = std::string{begin, ptr};
-      if (auto fn = states.find(s); fn != states.end())
-        return fn->second(result, n, ptr, start, end);
-      result.diags.push_back({
+      switch (ptr - begin == 3 ? mnemonic(begin) : 0) {
+        case mnemonic("TER"):
+          return parse_terminate(diags, n, ptr, start, end);
+        case mnemonic("PUS"):
+          return parse_push(diags, n, ptr, start, end);
+        case mnemonic("POP"):
+          return parse_unary<state_pop>(diags, n, ptr, start, end);
+        case mnemonic("MOV"):
+          return parse_binary<state_move>(diags, n, ptr, start, end);
+        case mnemonic("CPY"):
+          return parse_binary<state_copy>(diags, n, ptr, start, end);
+        case mnemonic("ADD"):
+          return parse_ternary<state_add>(diags, n, ptr, start, end);
+        case mnemonic("SUB"):
+          return parse_ternary<state_subtract>(diags, n, ptr, start, end);
+        case mnemonic("MUL"):
+          return parse_ternary<state_multiply>(diags, n, ptr, start, end);
+        case mnemonic("DIV"):
+          return parse_ternary<state_divide>(diags, n, ptr, start, end);
+        case mnemonic("MOD"):
+          return parse_ternary<state_modulo>(diags, n, ptr, start, end);
+        case mnemonic("EMP"):
+          return parse_empty(diags, n, ptr, start, end);
+        case mnemonic("CMP"):
+          return parse_less(diags, n, ptr, start, end);
+        case mnemonic("T00"):
+          return parse_unary<state_prefix_sum>(diags, n, ptr, start, end);
+        case mnemonic("T01"):
+          return parse_unary<state_suffix_sum>(diags, n, ptr, start, end);
+        case mnemonic("T02"):
+          return parse_unary<state_finite_difference>(diags, n, ptr, start, end);
+        case mnemonic("T03"):
+          return parse_unary<state_reverse>(diags, n, ptr, start, end);
+        case mnemonic("T04"):
+          return parse_unary<state_sort_ascending>(diags, n, ptr, start, end);
+        case mnemonic("T05"):
+          return parse_unary<state_sort_descending>(diags, n, ptr, start, end);
+        case mnemonic("T06"):
+          return parse_binary<state_rotate>(diags, n, ptr, start, end);
+        case mnemonic("T07"):
+          return parse_binary<state_bulk_move>(diags, n, ptr, start, end);
+        case mnemonic("T08"):
+          return parse_binary<state_bulk_copy>(diags, n, ptr, start, end);
+        case mnemonic("T09"):
+          return parse_binary<state_fill>(diags, n, ptr, start, end);
+        case mnemonic("T10"):
+          return parse_binary<state_iota>(diags, n, ptr, start, end);
+        case mnemonic("T11"):
+          return parse_binary<state_sum>(diags, n, ptr, start, end);
+        case mnemonic("T12"):
+          return parse_binary<state_product>(diags, n, ptr, start, end);
+        // T13 does not exist
+        case mnemonic("T14"):
+          return parse_binary<state_bulk_add>(diags, n, ptr, start, end);
+        case mnemonic("T15"):
+          return parse_binary<state_bulk_subtract>(diags, n, ptr, start, end);
+        case mnemonic("T16"):
+          return parse_binary<state_bulk_multiply>(diags, n, ptr, start, end);
+        case mnemonic("T17"):
+          return parse_binary<state_bulk_divide>(diags, n, ptr, start, end);
+        case mnemonic("T18"):
+          return parse_binary<state_bulk_modulo>(diags, n, ptr, start, end);
+        case mnemonic("T19"):
+          return parse_ternary<state_vector_add>(diags, n, ptr, start, end);
+        case mnemonic("T20"):
+          return parse_ternary<state_vector_subtract>(diags, n, ptr, start, end);
+        case mnemonic("T21"):
+          return parse_ternary<state_vector_multiply>(diags, n, ptr, start, end);
+      }
+      diags.push_back({
         static_cast<std::size_t>(begin - start),
         static_cast<std::size_t>(ptr - start),
         "unknown state type",
       });
       return std::nullopt;
     }
-  }
 
-  auto compile(const std::string& source) -> compile_result {
-    auto result = compile_result{};
-    auto start = source.c_str();
-    auto end = start + source.size();
-    auto ptr = start;
-    detail::skip_space(ptr);
-    std::size_t n;
-    {
-      auto conv = std::from_chars(ptr, end, n);
-      if (conv.ec == std::errc::invalid_argument) {
-        result.diags.push_back({
-          static_cast<std::size_t>(ptr - start),
-          static_cast<std::size_t>(ptr - start),
-          "invalid integer",
-        });
-        return result;
+    struct header {
+      std::size_t states = 0;
+      std::size_t init = -1;
+      bool complete = false;
+    };
+
+    auto parse_header(std::vector<diagnostic>& diags, std::size_t max_states, const char*& ptr, const char* start, const char* end) -> header {
+      auto result = header{};
+      skip_space(ptr, end);
+      std::size_t n;
+      {
+        auto conv = std::from_chars(ptr, end, n);
+        if (conv.ec == std::errc::invalid_argument) {
+          diags.push_back({
+            static_cast<std::size_t>(ptr - start),
+            static_cast<std::size_t>(ptr - start),
+            "invalid integer",
+          });
+          return result;
+        }
+        if (conv.ec == std::errc::result_out_of_range || n > max_states) {
+          diags.push_back({
+            static_cast<std::size_t>(ptr - start),
+            static_cast<std::size_t>(conv.ptr - start),
+            "too many states",
+          });
+          return result;
+        }
+        if (n == 0) {
+          diags.push_back({
+            static_cast<std::size_t>(ptr - start),
+            static_cast<std::size_t>(conv.ptr - start),
+            "too few states",
+          });
+          return result;
+        }
+        ptr = conv.ptr;
       }
-      if (conv.ec == std::errc::result_out_of_range || n > max_states) {
-        result.diags.push_back({
-          static_cast<std::size_t>(ptr - start),
-          static_cast<std::size_t>(conv.ptr - start),
-          "too many states",
-        });
+      result.states = n;
+      if (!expect_space(diags, ptr, start, end))
         return result;
-      }
-      if (n == 0) {
-        result.diags.push_back({
-          static_cast<std::size_t>(ptr - start),
-          static_cast<std::size_t>(conv.ptr - start),
-          "too few states",
-        });
+      result.init = expect_state(diags, n, ptr, start, end);
+      if (!~result.init)
         return result;
+      result.complete = expect_newline(diags, ptr, start, end);
+      return result;
+    }
+
+    auto trailer_size(std::size_t lines, std::size_t n) -> std::size_t {
+      return lines < n ? n - lines : lines > n;
+    }
+
+    auto check_trailer(std::vector<diagnostic>& diags, const std::vector<std::size_t>& lines, std::size_t n, const char* start, const char* end) -> void {
+      for (auto i = lines.size(); i < n; ++i)
+        diags.push_back({
+          static_cast<std::size_t>(end - start),
+          static_cast<std::size_t>(end - start),
+          "expected state type",
+        });
+      if (lines.size() >= n) {
+        auto ptr = lines.size() > n ? start + lines[n] : end;
+        expect_eof(diags, ptr, start, end);
       }
-      ptr = conv.ptr;
     }
-    result.prog.states.resize(n);
-    if (!detail::expect_space(result, ptr, start))
+
+    constexpr auto min_chunk = static_cast<std::size_t>(4096);
+
+    auto index_lines(std::vector<std::size_t>& lines, const char* ptr, const char* start, const char* end) -> void {
+      for (;;) {
+        skip_separator(ptr, end);
+        if (ptr == end)
+          break;
+        lines.push_back(static_cast<std::size_t>(ptr - start));
+        auto newline = static_cast<const char*>(std::memchr(ptr, '\n', static_cast<std::size_t>(end - ptr)));
+        if (!newline)
+          break;
+        ptr = newline + 1;
+      }
+    }
+
+    auto parse_lines(program& prog, std::vector<diagnostic>& diags, const std::vector<std::size_t>& lines, std::size_t n, std::size_t first, std::size_t last, const char* start, const char* end) -> void {
+      for (auto i = first; i < last; ++i) {
+        auto ptr = start + lines[i];
+        if (auto state = parse_line(diags, n, ptr, start, end))
+          prog.states[i] = *state;
+      }
+    }
+  }
+
+  auto compile(const std::string_view source, const compile_options& options) -> compile_result {
+    auto result = compile_result{};
+    auto start = source.data();
+    auto end = start + source.size();
+    auto ptr = start;
+    auto header = detail::parse_header(result.diags, options.max_states, ptr, start, end);
+    if (!header.states)
       return result;
-    auto init = detail::expect_state(result, n, ptr, start, end);
-    if (!~init)
+    auto n = header.states;
+    result.prog.states.resize(n);
+    if (!~header.init)
       return result;
-    result.prog.init = init;
-    if (!detail::expect_newline(result, ptr, start))
+    result.prog.init = header.init;
+    if (!header.complete)
       return result;
-    for (auto i = static_cast<std::size_t>(0); i < n; ++i) {
-      detail::skip_separator(ptr);
-      auto state = detail::parse_line(result, n, ptr, start, end);
-      if (state)
-        result.prog.states[i] = *state;
-      else
-        detail::skip_line(ptr);
-    }
-    detail::expect_eof(result, ptr, start);
+    detail::index_lines(result.lines, ptr, start, end);
+    auto parsed = std::min(n, result.lines.size());
+    auto jobs = options.jobs ? options.jobs : std::max(std::thread::hardware_concurrency(), 1u);
+    jobs = std::min(jobs, (parsed + detail::min_chunk - 1) / detail::min_chunk);
+    if (jobs > 1) {
+      auto chunks = std::vector<std::vector<diagnostic>>(jobs);
+      auto threads = std::vector<std::thread>{};
+      threads.reserve(jobs - 1);
+      for (auto j = static_cast<std::size_t>(1); j < jobs; ++j)
+        threads.emplace_back(detail::parse_lines, std::ref(result.prog), std::ref(chunks[j]), std::cref(result.lines), n, parsed * j / jobs, parsed * (j + 1) / jobs, start, end);
+      detail::parse_lines(result.prog, chunks[0], result.lines, n, 0, parsed / jobs, start, end);
+      for (auto& thread : threads)
+        thread.join();
+      for (auto& chunk : chunks)
+        result.diags.insert(result.diags.end(), chunk.begin(), chunk.end());
+    } else
+      detail::parse_lines(result.prog, result.diags, result.lines, n, 0, parsed, start, end);
+    detail::check_trailer(result.diags, result.lines, n, start, end);
     return result;
   }
+
+  auto recompile(compile_result& result, std::string& source, const source_edit& edit, const compile_options& options) -> void {
+    if (edit.start > edit.end || edit.end > source.size())
+      throw std::out_of_range{"edit out of range"};
+    auto full = [&] {
+      source.replace(edit.start, edit.end - edit.start, edit.text);
+      result = compile(source, options);
+    };
+    auto body = static_cast<std::size_t>(0);
+    {
+      auto diags = std::vector<diagnostic>{};
+      auto start = std::as_const(source).data();
+      auto ptr = start;
+      auto header = detail::parse_header(diags, options.max_states, ptr, start, start + source.size());
+      body = static_cast<std::size_t>(ptr - start);
+      if (!header.complete || header.states != result.prog.states.size() || header.init != result.prog.init || source[body - 1] != '\n' || edit.start < body)
+        return full();
+    }
+    auto n = result.prog.states.size();
+    auto& lines = result.lines;
+    auto& states = result.prog.states;
+    auto& diags = result.diags;
+    auto old_size = source.size();
+    auto old_lines = lines.size();
+    auto old_parsed = std::min(n, old_lines);
+    auto region_start = source.rfind('\n', edit.start - 1) + 1;
+    auto region_end = source.find('\n', edit.end);
+    region_end = ~region_end ? region_end + 1 : old_size;
+    auto first = static_cast<std::size_t>(std::lower_bound(lines.begin(), lines.end(), region_start) - lines.begin());
+    auto last = static_cast<std::size_t>(std::lower_bound(lines.begin(), lines.end(), region_end) - lines.begin());
+    diags.resize(diags.size() - detail::trailer_size(old_lines, n));
+    source.replace(edit.start, edit.end - edit.start, edit.text);
+    auto delta = static_cast<std::ptrdiff_t>(source.size()) - static_cast<std::ptrdiff_t>(old_size);
+    auto start = std::as_const(source).data();
+    auto end = start + source.size();
+    auto region = std::vector<std::size_t>{};
+    detail::index_lines(region, start + region_start, start, start + (region_end + delta));
+    auto count = region.size();
+    auto new_lines = old_lines - (last - first) + count;
+    auto parsed = std::min(n, new_lines);
+    // old line i >= last becomes line i + shift
+    auto shift = static_cast<std::ptrdiff_t>(count) - static_cast<std::ptrdiff_t>(last - first);
+    auto moved_end = std::min(old_parsed, static_cast<std::size_t>(std::max(static_cast<std::ptrdiff_t>(parsed) - shift, static_cast<std::ptrdiff_t>(0))));
+    auto diag_bound = [&](std::size_t i) {
+      return i < old_lines ? lines[i] : old_size + 1;
+    };
+    auto by_start = [](const diagnostic& diag, std::size_t pos) {
+      return diag.start < pos;
+    };
+    auto kept = std::lower_bound(diags.begin(), diags.end(), diag_bound(std::min(first, parsed)), by_start);
+    auto moved_first = std::lower_bound(kept, diags.end(), diag_bound(last), by_start);
+    auto moved_last = last < moved_end ? std::lower_bound(moved_first, diags.end(), diag_bound(moved_end), by_start) : moved_first;
+    auto moved = std::vector<diagnostic>(moved_first, moved_last);
+    for (auto& diag : moved) {
+      diag.start += delta;
+      diag.end += delta;
+    }
+    diags.erase(kept, diags.end());
+    if (shift > 0 && last < moved_end)
+      std::move_backward(states.begin() + last, states.begin() + moved_end, states.begin() + (moved_end + shift));
+    else if (shift < 0 && last < moved_end)
+      std::move(states.begin() + last, states.begin() + moved_end, states.begin() + (last + shift));
+    lines.erase(lines.begin() + first, lines.begin() + last);
+    lines.insert(lines.begin() + first, region.begin(), region.end());
+    for (auto i = first + count; i < lines.size(); ++i)
+      lines[i] += delta;
+    auto fresh_end = std::min(first + count, parsed);
+    for (auto i = first; i < fresh_end; ++i)
+      states[i] = state{};
+    detail::parse_lines(result.prog, diags, lines, n, first, fresh_end, start, end);
+    diags.insert(diags.end(), moved.begin(), moved.end());
+    auto reparse = std::max(fresh_end, last < moved_end ? moved_end + shift : first + count);
+    for (auto i = reparse; i < n; ++i)
+      states[i] = state{};
+    detail::parse_lines(result.prog, diags, lines, n, reparse, parsed, start, end);
+    detail::check_trailer(diags, lines, n, start, end);
+  }
 }
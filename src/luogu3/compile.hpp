@@ -4,15 +4,29 @@
 #include <luogu3/diagnostic.hpp>
 #include <luogu3/program.hpp>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace ud2::luogu3 {
+  struct compile_options {
+    std::size_t max_states = luogu3::max_states;
+    std::size_t jobs = 1;
+  };
+
   struct compile_result {
     std::vector<diagnostic> diags;
     program prog;
+    std::vector<std::size_t> lines;
+  };
+
+  struct source_edit {
+    std::size_t start;
+    std::size_t end;
+    std::string_view text;
   };
 
-  auto compile(const std::string& source) -> compile_result;
+  auto compile(std::string_view source, const compile_options& options = {}) -> compile_result;
+  auto recompile(compile_result& result, std::string& source, const source_edit& edit, const compile_options& options = {}) -> void;
 }
 
 #endif
@@ -0,0 +1,306 @@
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <luogu3/analysis.hpp>
+#include <luogu3/cfg.hpp>
+#include <luogu3/optimize.hpp>
+#include <map>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace ud2::luogu3 {
+  namespace detail {
+    constexpr auto max_thread_length = static_cast<std::size_t>(64);
+
+    using signature = std::array<std::size_t, 7>;
+
+    auto signature_of(const state& st) -> signature {
+      auto result = signature{st.index()};
+      std::fill(result.begin() + 1, result.end(), -1);
+      std::visit([&](const auto& s) {
+        if constexpr (requires { s.target; })
+          result[1] = s.target;
+        if constexpr (requires { s.from; })
+          result[2] = s.from;
+        if constexpr (requires { s.count; })
+          result[3] = s.count;
+        if constexpr (requires { s.left; })
+          result[4] = s.left;
+        if constexpr (requires { s.right; })
+          result[5] = s.right;
+        if constexpr (requires { s.val; })
+          result[6] = s.val;
+      }, st);
+      return result;
+    }
+
+    class partition {
+      std::vector<std::size_t> elements;
+      std::vector<std::size_t> location;
+      std::vector<std::size_t> first;
+      std::vector<std::size_t> last;
+      std::vector<std::size_t> marked;
+      std::vector<std::size_t> touched;
+
+    public:
+      std::vector<std::size_t> block;
+
+      partition(std::vector<std::size_t> initial, std::size_t blocks) : elements(initial.size()), location(initial.size()), first(blocks), last(blocks), marked(blocks), block(std::move(initial)) {
+        for (auto b : this->block)
+          ++this->last[b];
+        auto start = static_cast<std::size_t>(0);
+        for (auto b = static_cast<std::size_t>(0); b < blocks; ++b) {
+          this->first[b] = start;
+          start += this->last[b];
+          this->last[b] = this->first[b];
+        }
+        for (auto i = static_cast<std::size_t>(0); i < this->block.size(); ++i) {
+          auto& end = this->last[this->block[i]];
+          this->elements[end] = i;
+          this->location[i] = end++;
+        }
+      }
+
+      auto size() const -> std::size_t {
+        return this->first.size();
+      }
+
+      auto count(std::size_t b) const -> std::size_t {
+        return this->last[b] - this->first[b];
+      }
+
+      auto members(std::size_t b) const -> std::vector<std::size_t> {
+        return {this->elements.begin() + static_cast<std::ptrdiff_t>(this->first[b]), this->elements.begin() + static_cast<std::ptrdiff_t>(this->last[b])};
+      }
+
+      auto mark(std::size_t i) -> void {
+        auto b = this->block[i];
+        auto to = this->first[b] + this->marked[b];
+        auto from = this->location[i];
+        if (from < to)
+          return;
+        if (!this->marked[b])
+          this->touched.push_back(b);
+        std::swap(this->elements[from], this->elements[to]);
+        this->location[this->elements[from]] = from;
+        this->location[i] = to;
+        ++this->marked[b];
+      }
+
+      template <class F>
+      auto split(F f) -> void {
+        for (auto b : this->touched) {
+          auto m = std::exchange(this->marked[b], 0);
+          if (m == this->count(b))
+            continue;
+          auto c = this->size();
+          this->first.push_back(this->first[b]);
+          this->last.push_back(this->first[b] + m);
+          this->marked.push_back(0);
+          this->first[b] += m;
+          for (auto j = this->first[c]; j < this->last[c]; ++j)
+            this->block[this->elements[j]] = c;
+          f(b, c);
+        }
+        this->touched.clear();
+      }
+    };
+  }
+
+  auto renumber_states(program& prog, const std::vector<std::size_t>& mapping, std::vector<std::size_t>* origin) -> void {
+    auto n = prog.states.size();
+    auto m = static_cast<std::size_t>(0);
+    for (auto i = static_cast<std::size_t>(0); i < n; ++i)
+      if (~mapping[i])
+        m = std::max(m, mapping[i] + 1);
+    auto states = std::vector<state>(m);
+    auto assigned = std::vector<bool>(m);
+    auto origins = std::vector<std::size_t>(origin ? m : 0);
+    for (auto i = static_cast<std::size_t>(0); i < n; ++i) {
+      auto j = mapping[i];
+      if (!~j || assigned[j])
+        continue;
+      assigned[j] = true;
+      states[j] = std::move(prog.states[i]);
+      for_each_successor(states[j], [&](std::size_t& next) { next = mapping[next]; });
+      if (origin)
+        origins[j] = origin->empty() ? i : (*origin)[i];
+    }
+    prog.states = std::move(states);
+    prog.init = mapping[prog.init];
+    if (origin)
+      *origin = std::move(origins);
+  }
+
+  auto eliminate_dead_states(program& prog, std::vector<std::size_t>* origin) -> std::size_t {
+    auto n = prog.states.size();
+    auto live = reachable(cfg{prog});
+    auto mapping = std::vector<std::size_t>(n, -1);
+    auto m = static_cast<std::size_t>(0);
+    for (auto i = static_cast<std::size_t>(0); i < n; ++i)
+      if (live[i])
+        mapping[i] = m++;
+    if (m != n || origin)
+      renumber_states(prog, mapping, origin);
+    return n - m;
+  }
+
+  auto propagate_constants(program& prog, std::size_t capacity) -> std::size_t {
+    auto n = prog.states.size();
+    auto total = static_cast<std::size_t>(0);
+    for (;;) {
+      auto values = analyze_constants(prog);
+      auto heights = analyze_stack_heights(prog, capacity);
+      auto count = static_cast<std::size_t>(0);
+      for (auto i = static_cast<std::size_t>(0); i < n; ++i) {
+        if (!values[i])
+          continue;
+        auto replacement = std::visit([&](const auto& s) -> std::optional<state> {
+          using S = std::decay_t<decltype(s)>;
+          if constexpr (requires { s.target; s.next; }) {
+            if (auto val = evaluate(s, *values[i]))
+              return state_push{s.target, *val, s.next};
+          } else if constexpr (std::is_same_v<S, state_less>) {
+            const auto& left = (*values[i])[s.left];
+            const auto& right = (*values[i])[s.right];
+            if (!left.empty() && left.back() && !right.empty() && right.back())
+              return state_empty{s.left, *left.back() < *right.back() ? s.consequent : s.alternative, *left.back() < *right.back() ? s.consequent : s.alternative};
+          } else if constexpr (std::is_same_v<S, state_empty>) {
+            if (s.consequent == s.alternative || !heights[i])
+              return std::nullopt;
+            const auto& h = (*heights[i])[s.target];
+            if (!h.hi)
+              return state_empty{s.target, s.consequent, s.consequent};
+            if (h.lo || !(*values[i])[s.target].empty())
+              return state_empty{s.target, s.alternative, s.alternative};
+          }
+          return std::nullopt;
+        }, prog.states[i]);
+        if (replacement) {
+          prog.states[i] = *replacement;
+          ++count;
+        }
+      }
+      if (!count)
+        return total;
+      total += count;
+    }
+  }
+
+  auto thread_jumps(program& prog, std::size_t capacity) -> std::size_t {
+    auto heights = analyze_stack_heights(prog, capacity);
+    auto values = analyze_constants(prog);
+    auto count = static_cast<std::size_t>(0);
+    auto decide = [](const state& t, const stack_heights& h, const stack_values& v) -> std::optional<std::size_t> {
+      return std::visit([&](const auto& s) -> std::optional<std::size_t> {
+        using S = std::decay_t<decltype(s)>;
+        if constexpr (std::is_same_v<S, state_empty>) {
+          if (s.consequent == s.alternative || !h[s.target].hi)
+            return 0;
+          if (h[s.target].lo || !v[s.target].empty())
+            return 1;
+        } else if constexpr (std::is_same_v<S, state_less>) {
+          if ((!h[s.left].lo && v[s.left].empty()) || (!h[s.right].lo && v[s.right].empty()))
+            return std::nullopt;
+          if (s.consequent == s.alternative)
+            return 0;
+          if (!v[s.left].empty() && v[s.left].back() && !v[s.right].empty() && v[s.right].back())
+            return *v[s.left].back() < *v[s.right].back() ? 0 : 1;
+        }
+        return std::nullopt;
+      }, t);
+    };
+    auto thread = [&](std::size_t& target, stack_heights h, stack_values v) {
+      auto path = std::vector<std::size_t>{target};
+      for (auto i = target; path.size() <= detail::max_thread_length;) {
+        auto edge = decide(prog.states[i], h, v);
+        if (!edge)
+          break;
+        auto [next, trivial] = std::visit([&](const auto& s) -> std::pair<std::size_t, bool> {
+          if constexpr (requires { s.consequent; })
+            return {*edge ? s.alternative : s.consequent, s.consequent == s.alternative};
+          else
+            return {i, false};
+        }, prog.states[i]);
+        if (!trivial && (!transfer_heights(prog.states[i], *edge, h, capacity) || !transfer_values(prog.states[i], *edge, v)))
+          break;
+        i = next;
+        if (std::find(path.begin(), path.end(), i) != path.end())
+          break;
+        path.push_back(i);
+      }
+      if (path.back() != target) {
+        target = path.back();
+        ++count;
+      }
+    };
+    for (auto i = static_cast<std::size_t>(0); i < prog.states.size(); ++i) {
+      if (!heights[i] || !values[i])
+        continue;
+      auto edge = static_cast<std::size_t>(0);
+      auto current = prog.states[i];
+      for_each_successor(prog.states[i], [&](std::size_t& next) {
+        auto h = *heights[i];
+        auto v = *values[i];
+        if (transfer_heights(current, edge, h, capacity) && transfer_values(current, edge, v))
+          thread(next, std::move(h), std::move(v));
+        ++edge;
+      });
+    }
+    if (heights[prog.init] && values[prog.init])
+      thread(prog.init, *heights[prog.init], *values[prog.init]);
+    return count;
+  }
+
+  auto minimize_states(program& prog, std::vector<std::size_t>* origin) -> std::size_t {
+    auto n = prog.states.size();
+    auto ids = std::map<detail::signature, std::size_t>{};
+    auto initial = std::vector<std::size_t>(n);
+    auto inverse = std::array<std::vector<std::vector<std::size_t>>, 2>{std::vector<std::vector<std::size_t>>(n), std::vector<std::vector<std::size_t>>(n)};
+    for (auto i = static_cast<std::size_t>(0); i < n; ++i) {
+      initial[i] = ids.try_emplace(detail::signature_of(prog.states[i]), ids.size()).first->second;
+      auto edge = static_cast<std::size_t>(0);
+      for_each_successor(prog.states[i], [&](std::size_t next) { inverse[edge++][next].push_back(i); });
+    }
+    auto blocks = detail::partition{std::move(initial), ids.size()};
+    auto pending = std::vector<std::array<bool, 2>>{};
+    auto work = std::vector<std::pair<std::size_t, std::size_t>>{};
+    auto add = [&](std::size_t b, std::size_t edge) {
+      if (b >= pending.size())
+        pending.resize(b + 1);
+      if (!pending[b][edge]) {
+        pending[b][edge] = true;
+        work.emplace_back(b, edge);
+      }
+    };
+    for (auto b = static_cast<std::size_t>(0); b < blocks.size(); ++b)
+      for (auto edge : {0, 1})
+        add(b, edge);
+    while (!work.empty()) {
+      auto [b, edge] = work.back();
+      work.pop_back();
+      pending[b][edge] = false;
+      for (auto t : blocks.members(b))
+        for (auto s : inverse[edge][t])
+          blocks.mark(s);
+      blocks.split([&](std::size_t old, std::size_t created) {
+        for (auto e : {0, 1})
+          add(pending[old][e] || blocks.count(created) < blocks.count(old) ? created : old, e);
+      });
+    }
+    auto number = std::vector<std::size_t>(blocks.size(), -1);
+    auto mapping = std::vector<std::size_t>(n);
+    auto m = static_cast<std::size_t>(0);
+    for (auto i = static_cast<std::size_t>(0); i < n; ++i) {
+      auto& k = number[blocks.block[i]];
+      if (!~k)
+        k = m++;
+      mapping[i] = k;
+    }
+    if (m != n || origin)
+      renumber_states(prog, mapping, origin);
+    return n - m;
+  }
+}
@@ -0,0 +1,16 @@
+#ifndef LUOGU3_OPTIMIZE_HPP
+#define LUOGU3_OPTIMIZE_HPP
+
+#include <cstddef>
+#include <luogu3/program.hpp>
+#include <vector>
+
+namespace ud2::luogu3 {
+  auto renumber_states(program& prog, const std::vector<std::size_t>& mapping, std::vector<std::size_t>* origin = nullptr) -> void;
+  auto eliminate_dead_states(program& prog, std::vector<std::size_t>* origin = nullptr) -> std::size_t;
+  auto propagate_constants(program& prog, std::size_t capacity) -> std::size_t;
+  auto thread_jumps(program& prog, std::size_t capacity) -> std::size_t;
+  auto minimize_states(program& prog, std::vector<std::size_t>* origin = nullptr) -> std::size_t;
+}
+
+#endif
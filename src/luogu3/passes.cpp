@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <chrono>
+#include <config.h>
+#include <luogu3/analysis.hpp>
+#include <luogu3/optimize.hpp>
+#include <luogu3/passes.hpp>
+#include <stdexcept>
+#include <utility>
+#if HAVE_GETRUSAGE
+#include <sys/resource.h>
+#endif
+
+namespace ud2::luogu3 {
+  namespace detail {
+    auto counted(std::size_t count) -> pass_result {
+      auto result = pass_result{};
+      result.count = count;
+      return result;
+    }
+
+    auto builtin_passes() -> std::deque<pass> {
+      auto passes = std::deque<pass>{};
+      passes.push_back({"constants", "fold constant arithmetic and branches", "states folded", true, [](pass_state& s) {
+        return counted(propagate_constants(s.prog, s.capacity));
+      }});
+      passes.push_back({"thread-jumps", "redirect jumps past branches decided on the incoming edge", "jumps threaded", true, [](pass_state& s) {
+        return counted(thread_jumps(s.prog, s.capacity));
+      }});
+      passes.push_back({"dead-states", "remove states unreachable from the initial state", "unreachable states removed", true, [](pass_state& s) {
+        return counted(eliminate_dead_states(s.prog, &s.origin));
+      }});
+      passes.push_back({"merge-states", "merge states with the same instruction and equivalent successors", "equivalent states merged", true, [](pass_state& s) {
+        return counted(minimize_states(s.prog, &s.origin));
+      }});
+      passes.push_back({"loop-idioms", "emit drain, clear and fill loops as bulk operations", "loop idioms replaced", false, [](pass_state& s) {
+        return counted(recognize_loop_idioms(s.prog, s.idioms));
+      }});
+      passes.push_back({"bounds-checks", "drop stack bounds checks that can never fail", "bounds checks removed", false, [](pass_state& s) {
+        auto checks = bounds_check_hints(s.prog, s.capacity, s.hints);
+        return pass_result{checks.removed, checks.total};
+      }});
+      passes.push_back({"operands", "emit operands with known values as literals", "constant operands", false, [](pass_state& s) {
+        return counted(operand_hints(s.prog, s.hints));
+      }});
+      passes.push_back({"ranges", "skip modular reductions of operands with small enough value ranges", "operand ranges narrowed", false, [](pass_state& s) {
+        return counted(range_hints(s.prog, s.hints));
+      }});
+      passes.push_back({"fuse", "emit chains of states with a single predecessor as one block", "states fused", false, [](pass_state& s) {
+        return counted(fusion_chains(s.prog, s.hints, s.fused));
+      }});
+      return passes;
+    }
+
+    auto registry() -> std::deque<pass>& {
+      static auto passes = builtin_passes();
+      return passes;
+    }
+
+    auto max_resident() -> std::optional<std::size_t> {
+#if HAVE_GETRUSAGE
+      struct rusage usage;
+      if (!getrusage(RUSAGE_SELF, &usage))
+        return static_cast<std::size_t>(usage.ru_maxrss);
+#endif
+      return std::nullopt;
+    }
+  }
+
+  auto register_pass(pass p) -> void {
+    if (p.name.empty() || p.name.find(',') != std::string::npos)
+      throw std::invalid_argument{"invalid pass name"};
+    if (find_pass(p.name))
+      throw std::invalid_argument{"pass already registered: " + p.name};
+    detail::registry().push_back(std::move(p));
+  }
+
+  auto registered_passes() -> const std::deque<pass>& {
+    return detail::registry();
+  }
+
+  auto find_pass(std::string_view name) -> const pass* {
+    const auto& passes = detail::registry();
+    auto it = std::find_if(passes.begin(), passes.end(), [&](const pass& p) { return p.name == name; });
+    return it == passes.end() ? nullptr : &*it;
+  }
+
+  auto preset_pipeline(int level) -> std::vector<const pass*> {
+    switch (level) {
+      case 0:
+        return {};
+      case 1:
+        return parse_pipeline("constants,dead-states,bounds-checks,operands");
+      case 2:
+        return parse_pipeline("constants,thread-jumps,dead-states,merge-states,loop-idioms,bounds-checks,operands,ranges");
+      case 3:
+        return parse_pipeline("constants,thread-jumps,dead-states,merge-states,loop-idioms,bounds-checks,operands,ranges,fuse");
+      default:
+        throw std::invalid_argument{"optimization level must be between 0 and " + std::to_string(max_opt_level)};
+    }
+  }
+
+  auto parse_pipeline(std::string_view names) -> std::vector<const pass*> {
+    auto pipeline = std::vector<const pass*>{};
+    while (!names.empty()) {
+      auto end = names.find(',');
+      auto name = names.substr(0, end);
+      auto p = find_pass(name);
+      if (!p)
+        throw std::invalid_argument{"unknown pass: " + std::string{name}};
+      pipeline.push_back(p);
+      names = end == std::string_view::npos ? std::string_view{} : names.substr(end + 1);
+    }
+    return pipeline;
+  }
+
+  auto run_pipeline(pass_state& state, const std::vector<const pass*>& pipeline) -> std::vector<pass_report> {
+    auto reports = std::vector<pass_report>{};
+    for (auto p : pipeline) {
+      auto before = state.prog.states.size();
+      auto resident = detail::max_resident();
+      auto start = std::chrono::steady_clock::now();
+      auto result = p->run(state);
+      auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      if (p->transforms) {
+        state.hints.clear();
+        state.fused.clear();
+        state.idioms.clear();
+      }
+      auto peak_growth = std::optional<std::size_t>{};
+      if (auto after = detail::max_resident(); after && resident)
+        peak_growth = *after - *resident;
+      reports.push_back({p, result, seconds, before, state.prog.states.size(), peak_growth});
+    }
+    return reports;
+  }
+}
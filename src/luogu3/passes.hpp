@@ -0,0 +1,58 @@
+#ifndef LUOGU3_PASSES_HPP
+#define LUOGU3_PASSES_HPP
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <luogu3/program.hpp>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ud2::luogu3 {
+  constexpr auto default_opt_level = 2;
+  constexpr auto max_opt_level = 3;
+
+  struct pass_state {
+    program& prog;
+    std::size_t capacity;
+    std::vector<std::size_t> origin;
+    std::vector<emit_hints> hints;
+    std::vector<std::size_t> fused;
+    std::vector<loop_idiom> idioms;
+
+    explicit pass_state(program& prog, std::size_t capacity = stack_capacity) : prog{prog}, capacity{capacity} {}
+  };
+
+  struct pass_result {
+    std::size_t count = 0;
+    std::optional<std::size_t> total;
+  };
+
+  struct pass {
+    std::string name;
+    std::string description;
+    std::string stat;
+    bool transforms = true;
+    std::function<auto (pass_state&) -> pass_result> run;
+  };
+
+  struct pass_report {
+    const pass* p;
+    pass_result result;
+    double seconds;
+    std::size_t states_before;
+    std::size_t states_after;
+    std::optional<std::size_t> peak_growth;
+  };
+
+  auto register_pass(pass p) -> void;
+  auto registered_passes() -> const std::deque<pass>&;
+  auto find_pass(std::string_view name) -> const pass*;
+  auto preset_pipeline(int level) -> std::vector<const pass*>;
+  auto parse_pipeline(std::string_view names) -> std::vector<const pass*>;
+  auto run_pipeline(pass_state& state, const std::vector<const pass*>& pipeline) -> std::vector<pass_report>;
+}
+
+#endif
@@ -1,6 +1,19 @@
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
 #include <luogu3/program.hpp>
+#include <map>
+#include <numeric>
+#include <optional>
 #include <ostream>
 #include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
 
 namespace ud2::luogu3 {
   namespace detail {
@@ -16,6 +29,1549 @@ namespace ud2::luogu3 {
           throw std::invalid_argument{"unrepresentable stack"};
       }
     }
+
+    auto emit_sort_runtime(std::ostream& out, std::size_t capacity) -> void {
+      out
+        << "static uint_least32_t sort_scratch[" << capacity << "];\n"
+        << "\n"
+        << "static void sort_segment(uint_least32_t* ptr, uint_least32_t k, int descending) {\n"
+        << "  static uint_least32_t count[4][2048];\n"
+        << "  uint_least32_t* src = ptr;\n"
+        << "  uint_least32_t* dst = sort_scratch;\n"
+        << "  int up = 1;\n"
+        << "  int down = 1;\n"
+        << "  for (uint_least32_t i = 1; i < k && (up || down); ++i) {\n"
+        << "    up &= ptr[i - 1] <= ptr[i];\n"
+        << "    down &= ptr[i - 1] >= ptr[i];\n"
+        << "  }\n"
+        << "  if (descending ? down : up)\n"
+        << "    return;\n"
+        << "  if (descending ? up : down) {\n"
+        << "    for (uint_least32_t i = 0, j = k - 1; i < j; ++i, --j) {\n"
+        << "      uint_least32_t t = ptr[i];\n"
+        << "      ptr[i] = ptr[j];\n"
+        << "      ptr[j] = t;\n"
+        << "    }\n"
+        << "    return;\n"
+        << "  }\n"
+        << "  if (k <= " << sort_insertion_cutoff << ") {\n"
+        << "    for (uint_least32_t i = 1; i < k; ++i) {\n"
+        << "      uint_least32_t x = ptr[i];\n"
+        << "      uint_least32_t j = i;\n"
+        << "      for (; j && (descending ? ptr[j - 1] < x : ptr[j - 1] > x); --j)\n"
+        << "        ptr[j] = ptr[j - 1];\n"
+        << "      ptr[j] = x;\n"
+        << "    }\n"
+        << "    return;\n"
+        << "  }\n"
+        << "  int bits = k < " << sort_wide_radix_from << " ? 8 : 11;\n"
+        << "  int digits = (32 + bits - 1) / bits;\n"
+        << "  uint_least32_t buckets = (uint_least32_t) 1 << bits;\n"
+        << "  for (int d = 0; d < digits; ++d)\n"
+        << "    for (uint_least32_t i = 0; i < buckets; ++i)\n"
+        << "      count[d][i] = 0;\n"
+        << "  if (bits == 8)\n"
+        << "    for (uint_least32_t i = 0; i < k; ++i) {\n"
+        << "      ++count[0][ptr[i] & 255];\n"
+        << "      ++count[1][ptr[i] >> 8 & 255];\n"
+        << "      ++count[2][ptr[i] >> 16 & 255];\n"
+        << "      ++count[3][ptr[i] >> 24 & 255];\n"
+        << "    }\n"
+        << "  else\n"
+        << "    for (uint_least32_t i = 0; i < k; ++i) {\n"
+        << "      ++count[0][ptr[i] & 2047];\n"
+        << "      ++count[1][ptr[i] >> 11 & 2047];\n"
+        << "      ++count[2][ptr[i] >> 22 & 2047];\n"
+        << "    }\n"
+        << "  for (int d = 0; d < digits; ++d) {\n"
+        << "    uint_least32_t* c = count[d];\n"
+        << "    int shift = bits * d;\n"
+        << "    uint_least32_t mask = buckets - 1;\n"
+        << "    uint_least32_t sum = 0;\n"
+        << "    if (c[src[0] >> shift & mask] == k)\n"
+        << "      continue;\n"
+        << "    for (uint_least32_t i = 0; i < buckets; ++i) {\n"
+        << "      uint_least32_t* bucket = descending ? c + mask - i : c + i;\n"
+        << "      uint_least32_t n = *bucket;\n"
+        << "      *bucket = sum;\n"
+        << "      sum += n;\n"
+        << "    }\n"
+        << "    for (uint_least32_t i = 0; i < k; ++i)\n"
+        << "      dst[c[src[i] >> shift & mask]++] = src[i];\n"
+        << "    uint_least32_t* t = src;\n"
+        << "    src = dst;\n"
+        << "    dst = t;\n"
+        << "  }\n"
+        << "  if (src != ptr)\n"
+        << "    for (uint_least32_t i = 0; i < k; ++i)\n"
+        << "      ptr[i] = src[i];\n"
+        << "}\n"
+        << "\n";
+    }
+
+    // -modulo^-1 and 2^64 modulo the modulus, for Montgomery reduction with
+    // R = 2^32.
+    constexpr auto montgomery_factor = [] {
+      auto inverse = modulo;
+      for (auto i = 0; i < 5; ++i)
+        inverse *= 2 - modulo * inverse;
+      return static_cast<std::uint_least32_t>(-inverse);
+    }();
+    constexpr auto montgomery_r2 = static_cast<std::uint_least32_t>((UINT64_C(1) << 32) % modulo * ((UINT64_C(1) << 32) % modulo) % modulo);
+
+    auto emit_montgomery_runtime(std::ostream& out) -> void {
+      out
+        << "#ifdef __AVX2__\n"
+        << "#include <immintrin.h>\n"
+        << "\n"
+        << "static __m256i montgomery_reduce(__m256i even, __m256i odd) {\n"
+        << "  __m256i vf = _mm256_set1_epi32((int) UINT32_C(" << montgomery_factor << "));\n"
+        << "  __m256i vp = _mm256_set1_epi32((int) UINT32_C(" << modulo << "));\n"
+        << "  even = _mm256_add_epi64(even, _mm256_mul_epu32(_mm256_mul_epu32(even, vf), vp));\n"
+        << "  odd = _mm256_add_epi64(odd, _mm256_mul_epu32(_mm256_mul_epu32(odd, vf), vp));\n"
+        << "  return _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xaa);\n"
+        << "}\n"
+        << "#endif\n"
+        << "\n";
+    }
+
+    auto emit_multiply_runtime(std::ostream& out, const runtime_kernels& kernels) -> void {
+      out
+        << "#ifdef __AVX2__\n"
+        << "#include <immintrin.h>\n"
+        << "#endif\n"
+        << "\n";
+      if (kernels.multiply_scalar)
+        out
+          << "static void multiply_scalar(uint_least32_t* ptr, uint_least32_t k, uint_least32_t b) {\n"
+          << "  uint_least32_t i = 0;\n"
+          << "  b %= UINT32_C(" << modulo << ");\n"
+          << "  uint_least32_t w = (uint_least32_t) (((uint_least64_t) b << 32) / UINT32_C(" << modulo << "));\n"
+          << "#ifdef __AVX2__\n"
+          << "  __m256i vb = _mm256_set1_epi32((int) b);\n"
+          << "  __m256i vw = _mm256_set1_epi32((int) w);\n"
+          << "  __m256i vp = _mm256_set1_epi32((int) UINT32_C(" << modulo << "));\n"
+          << "  for (; i + 8 <= k; i += 8) {\n"
+          << "    __m256i x = _mm256_loadu_si256((const __m256i*) (ptr + i));\n"
+          << "    __m256i q = _mm256_blend_epi32(_mm256_srli_epi64(_mm256_mul_epu32(x, vw), 32), _mm256_mul_epu32(_mm256_srli_epi64(x, 32), vw), 0xaa);\n"
+          << "    __m256i r = _mm256_sub_epi32(_mm256_mullo_epi32(x, vb), _mm256_mullo_epi32(q, vp));\n"
+          << "    _mm256_storeu_si256((__m256i*) (ptr + i), _mm256_min_epu32(r, _mm256_sub_epi32(r, vp)));\n"
+          << "  }\n"
+          << "#endif\n"
+          << "  for (; i < k; ++i) {\n"
+          << "    uint_least32_t q = (uint_least32_t) ((uint_least64_t) ptr[i] * w >> 32);\n"
+          << "    uint_least32_t r = (uint_least32_t) (ptr[i] * b - q * UINT32_C(" << modulo << "));\n"
+          << "    ptr[i] = r >= UINT32_C(" << modulo << ") ? r - UINT32_C(" << modulo << ") : r;\n"
+          << "  }\n"
+          << "}\n"
+          << "\n";
+      if (kernels.multiply_elementwise)
+        out
+          << "static void multiply_elementwise(uint_least32_t* ptr, const uint_least32_t* left, const uint_least32_t* right, uint_least32_t k) {\n"
+          << "  uint_least32_t i = 0;\n"
+          << "#ifdef __AVX2__\n"
+          << "  __m256i vp = _mm256_set1_epi32((int) UINT32_C(" << modulo << "));\n"
+          << "  __m256i vp2 = _mm256_set1_epi32((int) UINT32_C(" << 2 * modulo << "));\n"
+          << "  __m256i vr2 = _mm256_set1_epi32((int) UINT32_C(" << montgomery_r2 << "));\n"
+          << "  for (; i + 8 <= k; i += 8) {\n"
+          << "    __m256i a = _mm256_loadu_si256((const __m256i*) (left + i));\n"
+          << "    __m256i b = _mm256_loadu_si256((const __m256i*) (right + i));\n"
+          << "    b = _mm256_min_epu32(b, _mm256_sub_epi32(b, vp2));\n"
+          << "    b = _mm256_min_epu32(b, _mm256_sub_epi32(b, vp2));\n"
+          << "    b = _mm256_min_epu32(b, _mm256_sub_epi32(b, vp));\n"
+          << "    __m256i u = montgomery_reduce(_mm256_mul_epu32(a, b), _mm256_mul_epu32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(b, 32)));\n"
+          << "    u = montgomery_reduce(_mm256_mul_epu32(u, vr2), _mm256_mul_epu32(_mm256_srli_epi64(u, 32), vr2));\n"
+          << "    _mm256_storeu_si256((__m256i*) (ptr + i), _mm256_min_epu32(u, _mm256_sub_epi32(u, vp)));\n"
+          << "  }\n"
+          << "#endif\n"
+          << "  for (; i < k; ++i)\n"
+          << "    ptr[i] = (uint_least32_t) ((uint_least64_t) left[i] * right[i] % UINT32_C(" << modulo << "));\n"
+          << "}\n"
+          << "\n";
+    }
+
+    auto emit_scan_runtime(std::ostream& out, const runtime_kernels& kernels) -> void {
+      out
+        << "#ifdef __SSE4_1__\n"
+        << "#include <smmintrin.h>\n"
+        << "#endif\n"
+        << "\n";
+      if (kernels.prefix_sum)
+        out
+          << "static void prefix_sum(uint_least32_t* ptr, uint_least32_t k) {\n"
+          << "  if (!k)\n"
+          << "    return;\n"
+          << "  uint_least32_t n = k - 1;\n"
+          << "#ifdef __SSE4_1__\n"
+          << "  __m128i vp = _mm_set1_epi32((int) UINT32_C(" << modulo << "));\n"
+          << "  __m128i vp2 = _mm_set1_epi32((int) UINT32_C(" << 2 * modulo << "));\n"
+          << "  __m128i carry = _mm_set1_epi32((int) ptr[n]);\n"
+          << "  for (; n >= 4; n -= 4) {\n"
+          << "    __m128i x = _mm_loadu_si128((const __m128i*) (ptr + n - 4));\n"
+          << "    x = _mm_add_epi32(x, _mm_srli_si128(x, 4));\n"
+          << "    x = _mm_add_epi32(x, _mm_srli_si128(x, 8));\n"
+          << "    x = _mm_min_epu32(x, _mm_sub_epi32(x, vp2));\n"
+          << "    x = _mm_min_epu32(x, _mm_sub_epi32(x, vp));\n"
+          << "    x = _mm_add_epi32(x, carry);\n"
+          << "    x = _mm_min_epu32(x, _mm_sub_epi32(x, vp));\n"
+          << "    _mm_storeu_si128((__m128i*) (ptr + n - 4), x);\n"
+          << "    carry = _mm_shuffle_epi32(x, 0x00);\n"
+          << "  }\n"
+          << "#endif\n"
+          << "  for (uint_least32_t sum = ptr[n]; n; --n) {\n"
+          << "    sum += ptr[n - 1];\n"
+          << "    sum = sum >= UINT32_C(" << modulo << ") ? sum - UINT32_C(" << modulo << ") : sum;\n"
+          << "    ptr[n - 1] = sum;\n"
+          << "  }\n"
+          << "}\n"
+          << "\n";
+      if (kernels.suffix_sum)
+        out
+          << "static void suffix_sum(uint_least32_t* ptr, uint_least32_t k) {\n"
+          << "  if (!k)\n"
+          << "    return;\n"
+          << "  uint_least32_t i = 1;\n"
+          << "#ifdef __SSE4_1__\n"
+          << "  __m128i vp = _mm_set1_epi32((int) UINT32_C(" << modulo << "));\n"
+          << "  __m128i vp2 = _mm_set1_epi32((int) UINT32_C(" << 2 * modulo << "));\n"
+          << "  __m128i carry = _mm_set1_epi32((int) ptr[0]);\n"
+          << "  for (; i + 4 <= k; i += 4) {\n"
+          << "    __m128i x = _mm_loadu_si128((const __m128i*) (ptr + i));\n"
+          << "    x = _mm_add_epi32(x, _mm_slli_si128(x, 4));\n"
+          << "    x = _mm_add_epi32(x, _mm_slli_si128(x, 8));\n"
+          << "    x = _mm_min_epu32(x, _mm_sub_epi32(x, vp2));\n"
+          << "    x = _mm_min_epu32(x, _mm_sub_epi32(x, vp));\n"
+          << "    x = _mm_add_epi32(x, carry);\n"
+          << "    x = _mm_min_epu32(x, _mm_sub_epi32(x, vp));\n"
+          << "    _mm_storeu_si128((__m128i*) (ptr + i), x);\n"
+          << "    carry = _mm_shuffle_epi32(x, 0xff);\n"
+          << "  }\n"
+          << "#endif\n"
+          << "  for (uint_least32_t sum = ptr[i - 1]; i < k; ++i) {\n"
+          << "    sum += ptr[i];\n"
+          << "    sum = sum >= UINT32_C(" << modulo << ") ? sum - UINT32_C(" << modulo << ") : sum;\n"
+          << "    ptr[i] = sum;\n"
+          << "  }\n"
+          << "}\n"
+          << "\n";
+      if (kernels.finite_difference)
+        out
+          << "static void finite_difference(uint_least32_t* ptr, uint_least32_t k) {\n"
+          << "  uint_least32_t i = 1;\n"
+          << "#ifdef __SSE4_1__\n"
+          << "  __m128i vp = _mm_set1_epi32((int) UINT32_C(" << modulo << "));\n"
+          << "  for (; i + 4 <= k; i += 4) {\n"
+          << "    __m128i x = _mm_sub_epi32(_mm_loadu_si128((const __m128i*) (ptr + i - 1)), _mm_loadu_si128((const __m128i*) (ptr + i)));\n"
+          << "    _mm_storeu_si128((__m128i*) (ptr + i - 1), _mm_min_epu32(x, _mm_add_epi32(x, vp)));\n"
+          << "  }\n"
+          << "#endif\n"
+          << "  for (; i < k; ++i) {\n"
+          << "    uint_least32_t x = ptr[i - 1] - ptr[i];\n"
+          << "    ptr[i - 1] = ptr[i - 1] < ptr[i] ? x + UINT32_C(" << modulo << ") : x;\n"
+          << "  }\n"
+          << "}\n"
+          << "\n";
+    }
+
+    // Number of independent vectors of Montgomery accumulators in the product
+    // kernel, enough to cover the latency of one reduction.
+    constexpr auto product_accumulators = static_cast<std::size_t>(4);
+
+    auto emit_reduce_runtime(std::ostream& out, const runtime_kernels& kernels) -> void {
+      out
+        << "#ifdef __AVX2__\n"
+        << "#include <immintrin.h>\n"
+        << "#endif\n"
+        << "\n";
+      // Values are below 2^30 and a segment has fewer than 2^32 of them, so
+      // the 64-bit lanes and their total stay below 2^62 and a single % at
+      // the end replaces a reduction per block.
+      if (kernels.sum)
+        out
+          << "static uint_least32_t sum_segment(const uint_least32_t* ptr, uint_least32_t k) {\n"
+          << "  uint_least64_t sum = 0;\n"
+          << "  uint_least32_t i = 0;\n"
+          << "#ifdef __AVX2__\n"
+          << "  __m256i mask = _mm256_set1_epi64x((long long) UINT64_C(0xffffffff));\n"
+          << "  __m256i even = _mm256_setzero_si256();\n"
+          << "  __m256i odd = _mm256_setzero_si256();\n"
+          << "  uint_least64_t lanes[4];\n"
+          << "  for (; i + 16 <= k; i += 16) {\n"
+          << "    __m256i x = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*) (ptr + i)), _mm256_loadu_si256((const __m256i*) (ptr + i + 8)));\n"
+          << "    even = _mm256_add_epi64(even, _mm256_and_si256(x, mask));\n"
+          << "    odd = _mm256_add_epi64(odd, _mm256_srli_epi64(x, 32));\n"
+          << "  }\n"
+          << "  _mm256_storeu_si256((__m256i*) lanes, _mm256_add_epi64(even, odd));\n"
+          << "  sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];\n"
+          << "#endif\n"
+          << "  for (; i < k; ++i)\n"
+          << "    sum += ptr[i];\n"
+          << "  return (uint_least32_t) (sum % UINT32_C(" << modulo << "));\n"
+          << "}\n"
+          << "\n";
+      if (kernels.product) {
+        auto lanes = 8 * product_accumulators;
+        out
+          << "static uint_least32_t montgomery_multiply(uint_least32_t a, uint_least32_t b) {\n"
+          << "  uint_least64_t t = (uint_least64_t) a * b;\n"
+          << "  return (uint_least32_t) ((t + (uint_least64_t) ((uint_least32_t) t * UINT32_C(" << montgomery_factor << ")) * UINT32_C(" << modulo << ")) >> 32);\n"
+          << "}\n"
+          << "\n"
+          << "static uint_least32_t product_segment(const uint_least32_t* ptr, uint_least32_t k) {\n"
+          << "  uint_least32_t acc[" << lanes << "];\n"
+          << "  uint_least64_t result = 1;\n"
+          << "  uint_least64_t r = UINT64_C(" << (UINT64_C(1) << 32) % modulo << ");\n"
+          << "  uint_least32_t i = 0;\n"
+          << "  uint_least32_t n;\n"
+          << "  for (n = 0; n < " << lanes << "; ++n)\n"
+          << "    acc[n] = 1;\n"
+          << "#ifdef __AVX2__\n"
+          << "  {\n"
+          << "    __m256i zero = _mm256_setzero_si256();\n";
+        for (auto j = static_cast<std::size_t>(0); j < product_accumulators; ++j)
+          out << "    __m256i acc" << j << " = _mm256_set1_epi32(1);\n";
+        out << "    for (; i + " << lanes << " <= k; i += " << lanes << ") {\n";
+        for (auto j = static_cast<std::size_t>(0); j < product_accumulators; ++j)
+          out << "      __m256i x" << j << " = _mm256_loadu_si256((const __m256i*) (ptr + i" << (j ? " + " + std::to_string(8 * j) : "") << "));\n";
+        out << "      __m256i z = _mm256_cmpeq_epi32(x0, zero);\n";
+        for (auto j = static_cast<std::size_t>(1); j < product_accumulators; ++j)
+          out << "      z = _mm256_or_si256(z, _mm256_cmpeq_epi32(x" << j << ", zero));\n";
+        out
+          << "      if (!_mm256_testz_si256(z, z))\n"
+          << "        return 0;\n";
+        for (auto j = static_cast<std::size_t>(0); j < product_accumulators; ++j)
+          out << "      acc" << j << " = montgomery_reduce(_mm256_mul_epu32(acc" << j << ", x" << j << "), _mm256_mul_epu32(_mm256_srli_epi64(acc" << j << ", 32), _mm256_srli_epi64(x" << j << ", 32)));\n";
+        out << "    }\n";
+        for (auto j = static_cast<std::size_t>(0); j < product_accumulators; ++j)
+          out << "    _mm256_storeu_si256((__m256i*) (acc" << (j ? " + " + std::to_string(8 * j) : "") << "), acc" << j << ");\n";
+        out
+          << "  }\n"
+          << "#endif\n"
+          << "  for (; i + 4 <= k; i += 4) {\n"
+          << "    if (!ptr[i] || !ptr[i + 1] || !ptr[i + 2] || !ptr[i + 3])\n"
+          << "      return 0;\n"
+          << "    acc[0] = montgomery_multiply(acc[0], ptr[i]);\n"
+          << "    acc[1] = montgomery_multiply(acc[1], ptr[i + 1]);\n"
+          << "    acc[2] = montgomery_multiply(acc[2], ptr[i + 2]);\n"
+          << "    acc[3] = montgomery_multiply(acc[3], ptr[i + 3]);\n"
+          << "  }\n"
+          << "  for (n = 0; n < " << lanes << "; ++n)\n"
+          << "    result = result * acc[n] % UINT32_C(" << modulo << ");\n"
+          << "  for (n = i; n; n >>= 1) {\n"
+          << "    if (n & 1)\n"
+          << "      result = result * r % UINT32_C(" << modulo << ");\n"
+          << "    r = r * r % UINT32_C(" << modulo << ");\n"
+          << "  }\n"
+          << "  for (; i < k; ++i)\n"
+          << "    result = result * ptr[i] % UINT32_C(" << modulo << ");\n"
+          << "  return (uint_least32_t) result;\n"
+          << "}\n"
+          << "\n";
+      }
+    }
+
+    // Rotations by at most this many elements either way shift the segment
+    // with one memmove through a buffer on the stack instead of reversing it
+    // three times.
+    constexpr auto rotate_buffer = static_cast<std::size_t>(256);
+
+    auto emit_movement_runtime(std::ostream& out, const runtime_kernels& kernels) -> void {
+      out
+        << "#include <string.h>\n"
+        << "#ifdef __AVX2__\n"
+        << "#include <immintrin.h>\n"
+        << "#endif\n"
+        << "#ifdef __SSE2__\n"
+        << "#include <emmintrin.h>\n"
+        << "#endif\n"
+        << "\n";
+      if (kernels.reverse || kernels.rotate)
+        out
+          << "static void reverse_segment(uint_least32_t* ptr, uint_least32_t k) {\n"
+          << "  uint_least32_t i = 0;\n"
+          << "  uint_least32_t j = k;\n"
+          << "#ifdef __AVX2__\n"
+          << "  __m256i order = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);\n"
+          << "  for (; i + 16 <= j; i += 8, j -= 8) {\n"
+          << "    __m256i a = _mm256_loadu_si256((const __m256i*) (ptr + i));\n"
+          << "    __m256i b = _mm256_loadu_si256((const __m256i*) (ptr + j - 8));\n"
+          << "    _mm256_storeu_si256((__m256i*) (ptr + i), _mm256_permutevar8x32_epi32(b, order));\n"
+          << "    _mm256_storeu_si256((__m256i*) (ptr + j - 8), _mm256_permutevar8x32_epi32(a, order));\n"
+          << "  }\n"
+          << "#endif\n"
+          << "#ifdef __SSE2__\n"
+          << "  for (; i + 8 <= j; i += 4, j -= 4) {\n"
+          << "    __m128i a = _mm_loadu_si128((const __m128i*) (ptr + i));\n"
+          << "    __m128i b = _mm_loadu_si128((const __m128i*) (ptr + j - 4));\n"
+          << "    _mm_storeu_si128((__m128i*) (ptr + i), _mm_shuffle_epi32(b, 0x1b));\n"
+          << "    _mm_storeu_si128((__m128i*) (ptr + j - 4), _mm_shuffle_epi32(a, 0x1b));\n"
+          << "  }\n"
+          << "#endif\n"
+          << "  for (; i + 1 < j; ++i, --j) {\n"
+          << "    uint_least32_t x = ptr[i];\n"
+          << "    ptr[i] = ptr[j - 1];\n"
+          << "    ptr[j - 1] = x;\n"
+          << "  }\n"
+          << "}\n"
+          << "\n";
+      if (kernels.rotate)
+        out
+          << "static void rotate_segment(uint_least32_t* ptr, uint_least32_t k, uint_least32_t c) {\n"
+          << "  uint_least32_t buffer[" << rotate_buffer << "];\n"
+          << "  if (!k)\n"
+          << "    return;\n"
+          << "  c %= k;\n"
+          << "  if (c <= " << rotate_buffer << ") {\n"
+          << "    memcpy(buffer, ptr + k - c, c * sizeof *ptr);\n"
+          << "    memmove(ptr + c, ptr, (k - c) * sizeof *ptr);\n"
+          << "    memcpy(ptr, buffer, c * sizeof *ptr);\n"
+          << "  } else if (k - c <= " << rotate_buffer << ") {\n"
+          << "    memcpy(buffer, ptr, (k - c) * sizeof *ptr);\n"
+          << "    memmove(ptr, ptr + k - c, c * sizeof *ptr);\n"
+          << "    memcpy(ptr + c, buffer, (k - c) * sizeof *ptr);\n"
+          << "  } else {\n"
+          << "    reverse_segment(ptr, k);\n"
+          << "    reverse_segment(ptr, c);\n"
+          << "    reverse_segment(ptr + c, k - c);\n"
+          << "  }\n"
+          << "}\n"
+          << "\n";
+    }
+
+    auto emit_guard_prologue(std::ostream& out, std::size_t stacks, const emit_options& options, const runtime_kernels& kernels) -> void {
+      out
+        << "#define _DEFAULT_SOURCE\n"
+        << "#include <inttypes.h>\n"
+        << "#include <signal.h>\n"
+        << "#include <stdio.h>\n"
+        << "#include <stdlib.h>\n"
+        << "#include <sys/mman.h>\n"
+        << "#include <unistd.h>\n"
+        << "\n"
+        << "#ifndef MAP_ANONYMOUS\n"
+        << "#define MAP_ANONYMOUS MAP_ANON\n"
+        << "#endif\n"
+        << "\n"
+        << "#ifdef __GNUC__\n"
+        << "#define barrier() __asm__ __volatile__(\"\" ::: \"memory\")\n"
+        << "#else\n"
+        << "#include <stdatomic.h>\n"
+        << "#define barrier() atomic_signal_fence(memory_order_seq_cst)\n"
+        << "#endif\n"
+        << "\n"
+        << "static char* guard[" << stacks << "][2];\n"
+        << "static size_t guard_size;\n"
+        << "static volatile sig_atomic_t underflow_code = 3;\n"
+        << "\n"
+        << "static void on_fault(int sig, siginfo_t* info, void* context) {\n"
+        << "  char* addr = (char*) info->si_addr;\n"
+        << "  int i;\n"
+        << "  (void) context;\n"
+        << "  for (i = 0; i < " << stacks << "; ++i) {\n"
+        << "    if (addr >= guard[i][0] && addr < guard[i][0] + guard_size)\n"
+        << "      _exit(underflow_code);\n"
+        << "    if (addr >= guard[i][1] && addr < guard[i][1] + guard_size)\n"
+        << "      _exit(1);\n"
+        << "  }\n"
+        << "  signal(sig, SIG_DFL);\n"
+        << "}\n"
+        << "\n";
+      emit_runtime(out, options.stack_capacity, kernels);
+      out
+        << "int main(void) {\n"
+        << "  uint_least32_t* stack[" << stacks << "];\n"
+        << "  {\n"
+        << "    size_t page = (size_t) sysconf(_SC_PAGESIZE);\n"
+        << "    size_t size = (size_t) " << options.stack_capacity << " * sizeof(uint_least32_t);\n"
+        << "    struct sigaction action;\n"
+        << "    int i;\n"
+        << "    if (size % page) {\n"
+        << "      fputs(\"stack capacity is not a multiple of the page size\\n\", stderr);\n"
+        << "      abort();\n"
+        << "    }\n"
+        << "    guard_size = page;\n"
+        << "    for (i = 0; i < " << stacks << "; ++i) {\n"
+        << "      char* base = (char*) mmap(NULL, size + 2 * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);\n"
+        << "      if (base == (char*) MAP_FAILED || mprotect(base, page, PROT_NONE) || mprotect(base + page + size, page, PROT_NONE)) {\n"
+        << "        perror(\"mmap\");\n"
+        << "        abort();\n"
+        << "      }\n"
+        << "      guard[i][0] = base;\n"
+        << "      guard[i][1] = base + page + size;\n"
+        << "      stack[i] = (uint_least32_t*) (base + page);\n"
+        << "    }\n"
+        << "    action.sa_sigaction = on_fault;\n"
+        << "    action.sa_flags = SA_SIGINFO;\n"
+        << "    sigemptyset(&action.sa_mask);\n"
+        << "    sigaction(SIGSEGV, &action, NULL);\n"
+        << "    sigaction(SIGBUS, &action, NULL);\n"
+        << "  }\n";
+    }
+
+    auto emit_overflow_check(std::ostream& out, const emit_options& options, const emit_hints& hints, std::size_t s) -> void {
+      if (!hints.check_overflow(s))
+        return;
+      if (options.guard_pages)
+        out
+          << "  (void) *(volatile uint_least32_t*) top[" << s << "];\n"
+          << "  barrier();\n";
+      else
+        out
+          << "  if (top[" << s << "] == stack[" << s << "] + " << options.stack_capacity << ")\n"
+          << "    return 1;\n";
+    }
+
+    auto emit_underflow_check(std::ostream& out, const emit_options& options, const emit_hints& hints, std::initializer_list<std::size_t> stacks, int code) -> void {
+      if (options.guard_pages) {
+        auto first = true;
+        for (auto s : stacks)
+          if (hints.check_underflow(s)) {
+            if (first)
+              out << "  underflow_code = " << code << ";\n";
+            out << "  (void) *(volatile uint_least32_t*) (top[" << s << "] - 1);\n";
+            first = false;
+          }
+        if (!first)
+          out << "  barrier();\n";
+        return;
+      }
+      auto first = true;
+      for (auto s : stacks)
+        if (hints.check_underflow(s)) {
+          out << (first ? "  if (" : " || ") << "top[" << s << "] == stack[" << s << "]";
+          first = false;
+        }
+      if (!first)
+        out
+          << ")\n"
+          << "    return " << code << ";\n";
+    }
+
+    struct operand {
+      std::optional<std::uint_least32_t> val;
+      std::size_t stack;
+      bool cached;
+      std::size_t local = -1;
+    };
+
+    auto operator<<(std::ostream& out, const operand& x) -> std::ostream& {
+      if (x.val)
+        return out << "UINT32_C(" << *x.val << ")";
+      if (~x.local)
+        return out << "v" << x.local;
+      if (x.cached)
+        return out << "tos" << x.stack;
+      return out << "top[" << x.stack << "][-1]";
+    }
+
+    auto constant_divisor(const operand& x) -> bool {
+      return x.val && *x.val && *x.val < modulo;
+    }
+
+    struct reciprocal {
+      operand dividend;
+      std::uint_least32_t divisor;
+    };
+
+    auto operator<<(std::ostream& out, const reciprocal& x) -> std::ostream& {
+      auto shift = 0;
+      while ((static_cast<std::uint_least64_t>(1) << shift) < x.divisor)
+        ++shift;
+      auto magic = ((static_cast<std::uint_least64_t>(1) << (32 + shift)) / x.divisor + 1) & 0xffffffff;
+      return out << "(uint_least32_t) (((((uint_least64_t) " << x.dividend << " * UINT32_C(" << magic << ")) >> 32) + " << x.dividend << ") >> " << shift << ")";
+    }
+
+    struct arithmetic {
+      char op;
+      operand left;
+      operand right;
+      value_range left_range;
+      value_range right_range;
+    };
+
+    auto operator<<(std::ostream& out, const arithmetic& x) -> std::ostream& {
+      switch (x.op) {
+        case '+':
+          if (static_cast<std::uint_least64_t>(x.left_range.hi) + x.right_range.hi < modulo)
+            return out << "(uint_least32_t) (" << x.left << " + " << x.right << ")";
+          return out << "(uint_least32_t) (" << x.left << " + " << x.right << " - (" << x.left << " + " << x.right << " >= UINT32_C(" << modulo << ") ? UINT32_C(" << modulo << ") : 0))";
+        case '-':
+          if (x.right_range.hi <= x.left_range.lo)
+            return out << "(uint_least32_t) (" << x.left << " - " << x.right << ")";
+          return out << "(uint_least32_t) (" << x.left << " >= " << x.right << " ? " << x.left << " - " << x.right << " : " << x.left << " + UINT32_C(" << modulo << ") - " << x.right << ")";
+        case '*':
+          if (static_cast<std::uint_least64_t>(x.left_range.hi) * x.right_range.hi < modulo)
+            return out << "(uint_least32_t) (" << x.left << " * " << x.right << ")";
+          return out << "(uint_least32_t) (((uint_least64_t) " << x.left << " * " << x.right << ") % UINT32_C(" << modulo << "))";
+        case '/':
+          if (constant_divisor(x.right))
+            return out << reciprocal{x.left, *x.right.val};
+          return out << x.left << " / " << x.right;
+        default:
+          if (constant_divisor(x.right))
+            return out << x.left << " - " << reciprocal{x.left, *x.right.val} << " * UINT32_C(" << *x.right.val << ")";
+          return out << x.left << " % " << x.right;
+      }
+    }
+
+    constexpr auto operator_of(const state_add&) -> char {
+      return '+';
+    }
+
+    constexpr auto operator_of(const state_subtract&) -> char {
+      return '-';
+    }
+
+    constexpr auto operator_of(const state_multiply&) -> char {
+      return '*';
+    }
+
+    constexpr auto operator_of(const state_divide&) -> char {
+      return '/';
+    }
+
+    constexpr auto operator_of(const state_modulo&) -> char {
+      return '%';
+    }
+
+    template <class F>
+    auto emit_result(std::ostream& out, const emit_options& options, std::size_t s, F value) -> void {
+      if (options.cache_top) {
+        out
+          << "  top[" << s << "][-1] = tos" << s << ";\n"
+          << "  ++top[" << s << "];\n"
+          << "  tos" << s << " = ";
+        value();
+        out << ";\n";
+      } else {
+        out << "  *top[" << s << "] = ";
+        value();
+        out
+          << ";\n"
+          << "  ++top[" << s << "];\n";
+      }
+    }
+
+    template <class S>
+    auto emit_arithmetic(std::ostream& out, const emit_options& options, const emit_hints& hints, const S& s) -> void {
+      auto left = operand{hints.left, s.left, options.cache_top};
+      auto right = operand{hints.right, s.right, options.cache_top};
+      emit_overflow_check(out, options, hints, s.target);
+      emit_underflow_check(out, options, hints, {s.left, s.right}, 3);
+      if ((operator_of(s) == '/' || operator_of(s) == '%') && hints.check_divisor())
+        out
+          << "  if (" << right << " == 0)\n"
+          << "    return 4;\n";
+      emit_result(out, options, s.target, [&] { out << arithmetic{operator_of(s), left, right, hints.left_range, hints.right_range}; });
+      out << "  goto state_" << s.next << ";\n";
+    }
+
+    template <class S>
+    constexpr auto is_fusable = std::is_same_v<S, state_push> || std::is_same_v<S, state_pop> || std::is_same_v<S, state_move> || std::is_same_v<S, state_copy> || requires (const S& s) { operator_of(s); };
+
+    template <class S>
+    constexpr auto ends_fusion = std::is_same_v<S, state_terminate> || std::is_same_v<S, state_empty> || std::is_same_v<S, state_less>;
+
+    struct fused_check {
+      bool overflow;
+      std::size_t stack;
+      std::ptrdiff_t offset;
+      int code;
+    };
+
+    auto emit_height_condition(std::ostream& out, const emit_options& options, const fused_check& c) -> void {
+      if (c.overflow && !c.offset)
+        out << "top[" << c.stack << "] == stack[" << c.stack << "] + " << options.stack_capacity;
+      else if (c.overflow)
+        out << "top[" << c.stack << "] - stack[" << c.stack << "] >= " << (static_cast<std::ptrdiff_t>(options.stack_capacity) - c.offset);
+      else if (!c.offset)
+        out << "top[" << c.stack << "] == stack[" << c.stack << "]";
+      else
+        out << "top[" << c.stack << "] - stack[" << c.stack << "] <= " << -c.offset;
+    }
+
+    class fused_block {
+      std::ostream& out;
+      const emit_options& options;
+      std::vector<std::size_t> popped;
+      std::vector<std::vector<operand>> pushed;
+      std::map<std::pair<std::size_t, std::size_t>, operand> loaded;
+      std::size_t locals = 0;
+      const char* indent;
+      const char* inputs = nullptr;
+      std::vector<std::size_t> carried;
+
+    public:
+      fused_block(std::ostream& out, const emit_options& options, std::size_t stacks, const char* indent = "    ") : out{out}, options{options}, popped(stacks), pushed(stacks), indent{indent} {}
+
+      auto bind(const char* inputs, const std::vector<std::size_t>& carried) -> void {
+        this->inputs = inputs;
+        this->carried = carried;
+      }
+
+      template <class F>
+      auto define(F value) -> operand {
+        this->out << this->indent << "uint_least32_t v" << this->locals << " = ";
+        value();
+        this->out << ";\n";
+        return operand{std::nullopt, 0, false, this->locals++};
+      }
+
+      auto peek(std::size_t s) -> operand {
+        if (!this->pushed[s].empty())
+          return this->pushed[s].back();
+        auto depth = this->popped[s];
+        auto [it, inserted] = this->loaded.try_emplace({s, depth});
+        if (inserted)
+          it->second = this->define([&] {
+            if (this->inputs && depth < this->carried[s])
+              this->out << this->inputs << '[' << (std::accumulate(this->carried.begin(), this->carried.begin() + s, static_cast<std::size_t>(0)) + depth) << ']';
+            else if (this->options.cache_top && !depth)
+              this->out << "tos" << s;
+            else
+              this->out << "top[" << s << "][-" << (depth + 1) << "]";
+          });
+        return it->second;
+      }
+
+      auto output(std::size_t s, std::size_t depth) const -> operand {
+        return this->pushed[s][this->pushed[s].size() - 1 - depth];
+      }
+
+      template <class S>
+      auto step(const S& s, const emit_hints& hints) -> void {
+        if constexpr (std::is_same_v<S, state_push>)
+          this->push(s.target, operand{s.val, s.target, false});
+        else if constexpr (std::is_same_v<S, state_pop>)
+          this->pop(s.target);
+        else if constexpr (std::is_same_v<S, state_move>) {
+          auto val = this->peek(s.from);
+          this->pop(s.from);
+          this->push(s.target, val);
+        } else if constexpr (std::is_same_v<S, state_copy>)
+          this->push(s.target, this->peek(s.from));
+        else {
+          auto left = hints.left ? operand{hints.left, s.left, false} : this->peek(s.left);
+          auto right = hints.right ? operand{hints.right, s.right, false} : this->peek(s.right);
+          if ((operator_of(s) == '/' || operator_of(s) == '%') && hints.check_divisor())
+            this->out
+              << this->indent << "if (" << right << " == 0)\n"
+              << this->indent << "  return 4;\n";
+          this->push(s.target, this->define([&] { this->out << arithmetic{operator_of(s), left, right, hints.left_range, hints.right_range}; }));
+        }
+      }
+
+      auto pop(std::size_t s) -> void {
+        if (this->pushed[s].empty())
+          ++this->popped[s];
+        else
+          this->pushed[s].pop_back();
+      }
+
+      auto push(std::size_t s, const operand& x) -> void {
+        this->pushed[s].push_back(x);
+      }
+
+      auto nonempty(std::size_t s) const -> bool {
+        return !this->pushed[s].empty();
+      }
+
+      auto flush() -> void {
+        for (auto s = static_cast<std::size_t>(0); s < this->popped.size(); ++s) {
+          auto p = static_cast<std::ptrdiff_t>(this->popped[s]);
+          const auto& values = this->pushed[s];
+          auto m = static_cast<std::ptrdiff_t>(values.size());
+          auto stored = this->options.cache_top && m ? m - 1 : m;
+          if (this->options.cache_top && m && !p)
+            this->out << "    top[" << s << "][-1] = tos" << s << ";\n";
+          for (auto j = static_cast<std::ptrdiff_t>(0); j < stored; ++j)
+            this->out << "    top[" << s << "][" << (j - p) << "] = " << values[j] << ";\n";
+          if (this->options.cache_top && m)
+            this->out << "    tos" << s << " = " << values.back() << ";\n";
+          else if (this->options.cache_top && p)
+            this->out << "    tos" << s << " = top[" << s << "][-" << (p + 1) << "];\n";
+          if (m - p == 1)
+            this->out << "    ++top[" << s << "];\n";
+          else if (m - p == -1)
+            this->out << "    --top[" << s << "];\n";
+          else if (m > p)
+            this->out << "    top[" << s << "] += " << (m - p) << ";\n";
+          else if (m < p)
+            this->out << "    top[" << s << "] -= " << (p - m) << ";\n";
+        }
+      }
+    };
+
+    template <class F>
+    auto emit_fused(std::ostream& out, const emit_options& options, std::size_t stacks, const std::vector<std::size_t>& chain, F state_at) -> void {
+      auto hints_of = [&](std::size_t i) { return i < options.hints.size() ? options.hints[i] : emit_hints{}; };
+      auto checks = std::vector<fused_check>{};
+      auto offset = std::vector<std::ptrdiff_t>(stacks);
+      for (auto i : chain) {
+        auto hints = hints_of(i);
+        auto overflow = [&](std::size_t s) {
+          if (hints.check_overflow(s) && offset[s] >= 0)
+            checks.push_back({true, s, offset[s], 1});
+        };
+        auto underflow = [&](std::size_t s, int code) {
+          if (hints.check_underflow(s) && offset[s] <= 0)
+            checks.push_back({false, s, offset[s], code});
+        };
+        std::visit([&](const auto& s) {
+          using S = std::decay_t<decltype(s)>;
+          if constexpr (std::is_same_v<S, state_push>) {
+            overflow(s.target);
+            ++offset[s.target];
+          } else if constexpr (std::is_same_v<S, state_pop>) {
+            underflow(s.target, 2);
+            --offset[s.target];
+          } else if constexpr (std::is_same_v<S, state_move>) {
+            overflow(s.target);
+            underflow(s.from, 2);
+            --offset[s.from];
+            ++offset[s.target];
+          } else if constexpr (std::is_same_v<S, state_copy>) {
+            overflow(s.target);
+            underflow(s.from, 3);
+            ++offset[s.target];
+          } else if constexpr (is_fusable<S>) {
+            overflow(s.target);
+            underflow(s.left, 3);
+            underflow(s.right, 3);
+            ++offset[s.target];
+          } else if constexpr (std::is_same_v<S, state_less>) {
+            underflow(s.left, 3);
+            underflow(s.right, 3);
+          }
+        }, state_at(i));
+      }
+      auto merged = std::vector<fused_check>{};
+      for (const auto& c : checks) {
+        auto it = std::find_if(merged.begin(), merged.end(), [&](const fused_check& m) { return m.overflow == c.overflow && m.stack == c.stack; });
+        if (it == merged.end())
+          merged.push_back(c);
+        else if (c.overflow ? c.offset > it->offset : c.offset < it->offset)
+          it->offset = c.offset;
+      }
+      out << "  {\n";
+      auto indent = "    ";
+      if (merged.size() < checks.size()) {
+        out << "    if (";
+        for (auto j = static_cast<std::size_t>(0); j < merged.size(); ++j) {
+          if (j)
+            out << " || ";
+          emit_height_condition(out, options, merged[j]);
+        }
+        out << ") {\n";
+        indent = "      ";
+      }
+      for (const auto& c : checks) {
+        out << indent << "if (";
+        emit_height_condition(out, options, c);
+        out
+          << ")\n"
+          << indent << "  return " << c.code << ";\n";
+      }
+      if (merged.size() < checks.size())
+        out << "    }\n";
+      auto block = fused_block{out, options, stacks};
+      for (auto k = static_cast<std::size_t>(0); k < chain.size(); ++k) {
+        auto i = chain[k];
+        auto hints = hints_of(i);
+        if (k) {
+          out << "    /* state_" << i;
+          if (i < options.origin.size())
+            out << ": state " << (options.origin[i] + 1);
+          out << " */\n";
+        }
+        auto operand_of = [&](const std::optional<std::uint_least32_t>& val, std::size_t s) { return val ? operand{val, s, false} : block.peek(s); };
+        std::visit([&](const auto& s) {
+          using S = std::decay_t<decltype(s)>;
+          if constexpr (is_fusable<S>) {
+            block.step(s, hints);
+            if (k + 1 == chain.size()) {
+              block.flush();
+              out << "    goto state_" << s.next << ";\n";
+            }
+          } else if constexpr (std::is_same_v<S, state_less>) {
+            auto left = operand_of(hints.left, s.left);
+            auto right = operand_of(hints.right, s.right);
+            block.flush();
+            out
+              << "    if (" << left << " < " << right << ")\n"
+              << "      goto state_" << s.consequent << ";\n"
+              << "    else\n"
+              << "      goto state_" << s.alternative << ";\n";
+          } else if constexpr (std::is_same_v<S, state_empty>) {
+            auto nonempty = block.nonempty(s.target);
+            block.flush();
+            if (s.consequent == s.alternative || nonempty)
+              out << "    goto state_" << (nonempty ? s.alternative : s.consequent) << ";\n";
+            else
+              out
+                << "    if (top[" << s.target << "] == stack[" << s.target << "])\n"
+                << "      goto state_" << s.consequent << ";\n"
+                << "    else\n"
+                << "      goto state_" << s.alternative << ";\n";
+          } else if constexpr (std::is_same_v<S, state_terminate>) {
+            block.flush();
+            out << "    goto end;\n";
+          }
+        }, state_at(i));
+      }
+      out << "  }\n";
+    }
+
+    struct closed_form {
+      std::vector<std::size_t> body;
+      std::vector<std::size_t> carried;
+      bool continue_if_less;
+    };
+
+    constexpr auto max_closed_form_body = static_cast<std::size_t>(32);
+    constexpr auto max_closed_form_values = static_cast<std::size_t>(8);
+
+    template <class F>
+    auto find_closed_form(std::size_t h, std::size_t stacks, F state_at) -> std::optional<closed_form> {
+      auto head = std::get<state_less>(state_at(h));
+      if (head.left == head.right)
+        return std::nullopt;
+      for (auto edge = 0; edge < 2; ++edge) {
+        auto result = closed_form{{}, std::vector<std::size_t>(stacks), !edge};
+        auto pushed = std::vector<std::size_t>(stacks);
+        auto valid = true;
+        for (auto i = edge ? head.alternative : head.consequent; valid && i != h;) {
+          if (result.body.size() == max_closed_form_body) {
+            valid = false;
+            break;
+          }
+          result.body.push_back(i);
+          auto pop = [&](std::size_t s) {
+            if (pushed[s])
+              --pushed[s];
+            else
+              ++result.carried[s];
+          };
+          std::visit([&](const auto& s) {
+            using S = std::decay_t<decltype(s)>;
+            if constexpr (is_fusable<S>) {
+              if constexpr (requires { operator_of(s); })
+                valid = operator_of(s) != '/' && operator_of(s) != '%';
+              if constexpr (std::is_same_v<S, state_pop>)
+                pop(s.target);
+              else {
+                if constexpr (std::is_same_v<S, state_move>)
+                  pop(s.from);
+                ++pushed[s.target];
+              }
+              i = s.next;
+            } else
+              valid = false;
+          }, state_at(i));
+        }
+        if (!valid || pushed != result.carried)
+          continue;
+        auto values = std::accumulate(result.carried.begin(), result.carried.end(), static_cast<std::size_t>(0));
+        if (!values || values > max_closed_form_values || (!result.carried[head.left] && !result.carried[head.right]))
+          continue;
+        auto degrees = std::vector<std::vector<int>>(stacks);
+        auto popped = std::vector<std::size_t>(stacks);
+        auto peek = [&](std::size_t s) { return degrees[s].empty() ? static_cast<int>(popped[s] < result.carried[s]) : degrees[s].back(); };
+        auto pop = [&](std::size_t s) {
+          if (degrees[s].empty())
+            ++popped[s];
+          else
+            degrees[s].pop_back();
+        };
+        for (auto i : result.body)
+          std::visit([&](const auto& s) {
+            using S = std::decay_t<decltype(s)>;
+            if constexpr (std::is_same_v<S, state_push>)
+              degrees[s.target].push_back(0);
+            else if constexpr (std::is_same_v<S, state_pop>)
+              pop(s.target);
+            else if constexpr (std::is_same_v<S, state_move>) {
+              auto degree = peek(s.from);
+              pop(s.from);
+              degrees[s.target].push_back(degree);
+            } else if constexpr (std::is_same_v<S, state_copy>)
+              degrees[s.target].push_back(peek(s.from));
+            else if constexpr (is_fusable<S>) {
+              auto degree = operator_of(s) == '*' ? peek(s.left) + peek(s.right) : std::max(peek(s.left), peek(s.right));
+              valid = valid && degree <= 1;
+              degrees[s.target].push_back(degree);
+            }
+          }, state_at(i));
+        if (valid)
+          return result;
+      }
+      return std::nullopt;
+    }
+
+    auto emit_matrix_product(std::ostream& out, const char* result, const char* left, const char* right, std::size_t size) -> void {
+      out
+        << "      for (a = 0; a < " << size << "; ++a)\n"
+        << "        for (b = 0; b < " << size << "; ++b) {\n"
+        << "          uint_least64_t sum = 0;\n"
+        << "          for (c = 0; c < " << size << "; ++c)\n"
+        << "            sum = (sum + (uint_least64_t) " << left << "[a][c] * " << right << "[c][b]) % UINT32_C(" << modulo << ");\n"
+        << "          t[a][b] = (uint_least32_t) sum;\n"
+        << "        }\n"
+        << "      for (a = 0; a < " << size << "; ++a)\n"
+        << "        for (b = 0; b < " << size << "; ++b)\n"
+        << "          " << result << "[a][b] = t[a][b];\n";
+    }
+
+    template <class F>
+    auto emit_closed_form(std::ostream& out, const emit_options& options, std::size_t h, const closed_form& form, F state_at) -> void {
+      auto head = std::get<state_less>(state_at(h));
+      auto stacks = form.carried.size();
+      auto k = std::accumulate(form.carried.begin(), form.carried.end(), static_cast<std::size_t>(0));
+      auto index = [&](std::size_t s) { return std::accumulate(form.carried.begin(), form.carried.begin() + s, static_cast<std::size_t>(0)); };
+      auto counter_left = form.carried[head.left] > 0;
+      auto counter = counter_left ? head.left : head.right;
+      auto bound = counter_left ? head.right : head.left;
+      auto exit = form.continue_if_less ? head.alternative : head.consequent;
+      auto need = std::vector<std::ptrdiff_t>(stacks);
+      auto room = std::vector<std::ptrdiff_t>(stacks);
+      auto offset = std::vector<std::ptrdiff_t>(stacks);
+      auto underflow = [&](std::size_t s) { need[s] = std::max(need[s], 1 - offset[s]); };
+      auto overflow = [&](std::size_t s) { room[s] = std::max(room[s], offset[s] + 1); };
+      need[head.left] = need[head.right] = 1;
+      for (auto i : form.body)
+        std::visit([&](const auto& s) {
+          using S = std::decay_t<decltype(s)>;
+          if constexpr (std::is_same_v<S, state_push>) {
+            overflow(s.target);
+            ++offset[s.target];
+          } else if constexpr (std::is_same_v<S, state_pop>) {
+            underflow(s.target);
+            --offset[s.target];
+          } else if constexpr (std::is_same_v<S, state_move>) {
+            overflow(s.target);
+            underflow(s.from);
+            --offset[s.from];
+            ++offset[s.target];
+          } else if constexpr (std::is_same_v<S, state_copy>) {
+            overflow(s.target);
+            underflow(s.from);
+            ++offset[s.target];
+          } else if constexpr (is_fusable<S>) {
+            overflow(s.target);
+            underflow(s.left);
+            underflow(s.right);
+            ++offset[s.target];
+          }
+        }, state_at(i));
+      auto read = [&](std::size_t s, std::size_t depth) -> std::string {
+        if (options.cache_top && !depth)
+          return "tos" + std::to_string(s);
+        return "top[" + std::to_string(s) + "][-" + std::to_string(depth + 1) + "]";
+      };
+      auto emit_body = [&](bool basis) {
+        auto block = fused_block{out, options, stacks, "      "};
+        block.bind("e", form.carried);
+        for (auto i : form.body)
+          std::visit([&](const auto& s) {
+            if constexpr (is_fusable<std::decay_t<decltype(s)>>)
+              block.step(s, emit_hints{});
+          }, state_at(i));
+        for (auto s = static_cast<std::size_t>(0); s < stacks; ++s)
+          for (auto d = static_cast<std::size_t>(0); d < form.carried[s]; ++d) {
+            if (basis)
+              out << "      m[" << (index(s) + d) << "][j] = (uint_least32_t) ((UINT64_C(" << modulo << ") + " << block.output(s, d) << " - m[" << (index(s) + d) << "][" << k << "]) % UINT32_C(" << modulo << "));\n";
+            else
+              out << "      m[" << (index(s) + d) << "][" << k << "] = " << block.output(s, d) << ";\n";
+          }
+      };
+      out
+        << "  {\n"
+        << "    uint_least32_t x[" << k << "], m[" << (k + 1) << "][" << (k + 1) << "], r[" << (k + 1) << "][" << (k + 1) << "], t[" << (k + 1) << "][" << (k + 1) << "];\n"
+        << "    uint_least64_t counter, bound, step, n;\n"
+        << "    size_t a, b, c, j;\n"
+        << "    if (";
+      auto first = true;
+      for (auto s = static_cast<std::size_t>(0); s < stacks; ++s) {
+        if (need[s]) {
+          out << (first ? "" : " || ") << "top[" << s << "] - stack[" << s << "] < " << need[s];
+          first = false;
+        }
+        if (room[s]) {
+          out << (first ? "" : " || ") << "top[" << s << "] - stack[" << s << "] > " << (static_cast<std::ptrdiff_t>(options.stack_capacity) - room[s]);
+          first = false;
+        }
+      }
+      out
+        << ")\n"
+        << "      goto loop_" << h << ";\n";
+      for (auto s = static_cast<std::size_t>(0); s < stacks; ++s)
+        for (auto d = static_cast<std::size_t>(0); d < form.carried[s]; ++d)
+          out << "    x[" << (index(s) + d) << "] = " << read(s, d) << ";\n";
+      out
+        << "    {\n"
+        << "      uint_least32_t e[" << k << "] = {0};\n";
+      emit_body(false);
+      out
+        << "    }\n"
+        << "    counter = x[" << index(counter) << "];\n"
+        << "    bound = " << (form.carried[bound] ? "x[" + std::to_string(index(bound)) + "]" : read(bound, 0)) << ";\n"
+        << "    step = m[" << index(counter) << "][" << k << "];\n"
+        << "    if (!step)\n"
+        << "      goto loop_" << h << ";\n";
+      auto increasing = counter_left == form.continue_if_less;
+      if (increasing) {
+        if (counter_left)
+          out
+            << "    if (counter >= bound)\n"
+            << "      goto loop_" << h << ";\n"
+            << "    n = (bound - counter + step - 1) / step;\n";
+        else
+          out
+            << "    if (counter > bound)\n"
+            << "      goto loop_" << h << ";\n"
+            << "    n = (bound - counter) / step + 1;\n";
+        out
+          << "    if (counter + step * n >= UINT32_C(" << modulo << "))\n"
+          << "      goto loop_" << h << ";\n";
+      } else {
+        out << "    step = UINT32_C(" << modulo << ") - step;\n";
+        if (counter_left)
+          out
+            << "    if (counter < bound)\n"
+            << "      goto loop_" << h << ";\n"
+            << "    n = (counter - bound) / step + 1;\n";
+        else
+          out
+            << "    if (counter <= bound)\n"
+            << "      goto loop_" << h << ";\n"
+            << "    n = (counter - bound + step - 1) / step;\n";
+        out
+          << "    if (counter < step * n)\n"
+          << "      goto loop_" << h << ";\n";
+      }
+      out
+        << "    for (j = 0; j < " << k << "; ++j) {\n"
+        << "      uint_least32_t e[" << k << "];\n"
+        << "      for (a = 0; a < " << k << "; ++a)\n"
+        << "        e[a] = a == j;\n";
+      emit_body(true);
+      out
+        << "    }\n"
+        << "    for (a = 0; a < " << k << "; ++a)\n"
+        << "      if (m[" << index(counter) << "][a] != (a == " << index(counter) << ")";
+      if (form.carried[bound])
+        out << " || m[" << index(bound) << "][a] != (a == " << index(bound) << ")";
+      out
+        << ")\n"
+        << "        goto loop_" << h << ";\n";
+      if (form.carried[bound])
+        out
+          << "    if (m[" << index(bound) << "][" << k << "])\n"
+          << "      goto loop_" << h << ";\n";
+      out
+        << "    for (a = 0; a <= " << k << "; ++a) {\n"
+        << "      m[" << k << "][a] = a == " << k << ";\n"
+        << "      for (b = 0; b <= " << k << "; ++b)\n"
+        << "        r[a][b] = a == b;\n"
+        << "    }\n"
+        << "    for (;;) {\n"
+        << "      if (n & 1) {\n";
+      emit_matrix_product(out, "r", "r", "m", k + 1);
+      out
+        << "      }\n"
+        << "      n >>= 1;\n"
+        << "      if (!n)\n"
+        << "        break;\n";
+      emit_matrix_product(out, "m", "m", "m", k + 1);
+      out
+        << "    }\n";
+      for (auto s = static_cast<std::size_t>(0); s < stacks; ++s)
+        for (auto d = static_cast<std::size_t>(0); d < form.carried[s]; ++d) {
+          out
+            << "    {\n"
+            << "      uint_least64_t sum = r[" << (index(s) + d) << "][" << k << "];\n"
+            << "      for (c = 0; c < " << k << "; ++c)\n"
+            << "        sum = (sum + (uint_least64_t) r[" << (index(s) + d) << "][c] * x[c]) % UINT32_C(" << modulo << ");\n"
+            << "      " << read(s, d) << " = (uint_least32_t) sum;\n"
+            << "    }\n";
+        }
+      out
+        << "    goto state_" << exit << ";\n"
+        << "  }\n"
+        << "loop_" << h << ":\n";
+    }
+
+    auto emit_spill(std::ostream& out, const emit_options& options, std::initializer_list<std::size_t> stacks) -> void {
+      if (options.cache_top)
+        for (auto s : stacks)
+          out << "  top[" << s << "][-1] = tos" << s << ";\n";
+    }
+
+    auto emit_reload(std::ostream& out, const emit_options& options, std::initializer_list<std::size_t> stacks) -> void {
+      if (options.cache_top)
+        for (auto s : stacks)
+          out << "  tos" << s << " = top[" << s << "][-1];\n";
+    }
+
+    auto emit_room_check(std::ostream& out, const emit_options& options, std::size_t s, const char* count) -> void {
+      out
+        << "    if (" << count << " > (size_t) (stack[" << s << "] + " << options.stack_capacity << " - top[" << s << "]))\n"
+        << "      return 1;\n";
+    }
+
+    // Replaces the loop headed by head. The room on the target is checked
+    // once, so an overflow still exits with 1 and other exit codes are
+    // unchanged.
+    auto emit_loop_idiom(std::ostream& out, const emit_options& options, const state_empty& head, const loop_idiom& idiom) -> void {
+      auto x = head.target;
+      std::visit([&](const auto& l) {
+        using L = std::decay_t<decltype(l)>;
+        if constexpr (std::is_same_v<L, loop_clear>)
+          out
+            << "  top[" << x << "] = stack[" << x << "];\n";
+        else if constexpr (!std::is_same_v<L, std::monostate>) {
+          if (l.target == x)
+            throw std::invalid_argument{"loop idiom onto the same stack"};
+          if constexpr (std::is_same_v<L, loop_drain>)
+            emit_spill(out, options, {l.target, x});
+          else
+            emit_spill(out, options, {l.target});
+          out
+            << "  {\n";
+          if constexpr (std::is_same_v<L, loop_drain>)
+            out
+              << "    uint_least32_t* src = stack[" << x << "];\n";
+          out
+            << "    uint_least32_t* dst = top[" << l.target << "];\n"
+            << "    size_t k = (size_t) (top[" << x << "] - stack[" << x << "]);\n"
+            << "    size_t i;\n";
+          emit_room_check(out, options, l.target, "k");
+          out
+            << "    for (i = 0; i < k; ++i)\n";
+          if constexpr (std::is_same_v<L, loop_drain>)
+            out
+              << "      dst[i] = src[k - 1 - i];\n";
+          else
+            out
+              << "      dst[i] = UINT32_C(" << l.val << ");\n";
+          out
+            << "    top[" << l.target << "] += k;\n"
+            << "    top[" << x << "] = stack[" << x << "];\n"
+            << "  }\n";
+          emit_reload(out, options, {l.target});
+        }
+      }, idiom);
+      out << "  goto state_" << head.consequent << ";\n";
+    }
+
+    template <class S>
+    auto emit_bulk_transfer(std::ostream& out, const emit_options& options, const emit_hints& hints, const S& s) -> void {
+      constexpr auto move = std::is_same_v<S, state_bulk_move>;
+      emit_underflow_check(out, options, hints, {s.from}, 3);
+      out
+        << "  {\n"
+        << "    uint_least32_t k = " << operand{std::nullopt, s.from, options.cache_top} << ";\n"
+        << "    uint_least32_t* src;\n"
+        << "    if (top[" << s.from << "] - 1 - stack[" << s.from << "] < k)\n"
+        << "      return 3;\n"
+        << "    src = top[" << s.from << "] - 1 - k;\n";
+      if (move && s.target == s.from)
+        out
+          << "    memmove(src + 1, src, k * sizeof *src);\n"
+          << "    *src = k;\n";
+      else {
+        emit_room_check(out, options, s.target, "k");
+        if (options.cache_top)
+          out << "    top[" << s.target << "][-1] = tos" << s.target << ";\n";
+        out
+          << "    memcpy(top[" << s.target << "], src, k * sizeof *src);\n"
+          << "    top[" << s.target << "] += k;\n";
+        if (move) {
+          out << "    top[" << s.from << "] = src + 1;\n";
+          if (!options.cache_top)
+            out << "    *src = k;\n";
+        }
+      }
+      if (options.cache_top)
+        out << "    tos" << s.target << " = top[" << s.target << "][-1];\n";
+      out
+        << "  }\n"
+        << "  goto state_" << s.next << ";\n";
+    }
+
+    template <class S>
+    auto emit_reduction(std::ostream& out, const emit_options& options, const emit_hints& hints, const S& s, const char* kernel) -> void {
+      emit_overflow_check(out, options, hints, s.target);
+      emit_underflow_check(out, options, hints, {s.from}, 3);
+      out
+        << "  {\n"
+        << "    uint_least32_t k = " << operand{std::nullopt, s.from, options.cache_top} << ";\n"
+        << "    uint_least32_t val;\n"
+        << "    if (top[" << s.from << "] - 1 - stack[" << s.from << "] < k)\n"
+        << "      return 3;\n"
+        << "    val = " << kernel << "(top[" << s.from << "] - 1 - k, k);\n";
+      if (options.cache_top)
+        out
+          << "    top[" << s.target << "][-1] = tos" << s.target << ";\n"
+          << "    ++top[" << s.target << "];\n"
+          << "    tos" << s.target << " = val;\n";
+      else
+        out
+          << "    *top[" << s.target << "] = val;\n"
+          << "    ++top[" << s.target << "];\n";
+      out
+        << "  }\n"
+        << "  goto state_" << s.next << ";\n";
+    }
+
+    template <class S, class F>
+    constexpr auto for_each_stack(S& s, F f) -> void {
+      [[maybe_unused]] auto i = static_cast<std::size_t>(0);
+      if constexpr (requires { s.target; })
+        f(i++, s.target);
+      if constexpr (requires { s.from; })
+        f(i++, s.from);
+      if constexpr (requires { s.count; })
+        f(i++, s.count);
+      if constexpr (requires { s.left; })
+        f(i++, s.left);
+      if constexpr (requires { s.right; })
+        f(i++, s.right);
+    }
+
+    template <class S, class F>
+    auto for_each_successor(S& s, F f) -> void {
+      if constexpr (requires { s.next; })
+        f(0, s.next);
+      if constexpr (requires { s.consequent; }) {
+        f(0, s.consequent);
+        f(1, s.alternative);
+      }
+    }
+
+    // Source mnemonics indexed by opcode, the index of a state type in state.
+    constexpr const char* mnemonics[] = {
+      "TER", "PUS", "POP", "MOV", "CPY", "ADD", "SUB", "MUL", "DIV", "MOD", "EMP", "CMP",
+      "T00", "T01", "T02", "T03", "T04", "T05", "T06", "T07", "T08", "T09", "T10", "T11",
+      "T12", "T14", "T15", "T16", "T17", "T18", "T19", "T20", "T21",
+    };
+
+    static_assert(std::size(mnemonics) == std::variant_size_v<state>);
+
+    template <class S, std::size_t I = 0>
+    constexpr auto opcode() -> std::uint8_t {
+      if constexpr (std::is_same_v<std::variant_alternative_t<I, state>, S>)
+        return I;
+      else
+        return opcode<S, I + 1>();
+    }
+
+    template <std::size_t... I>
+    constexpr auto stack_operands(std::index_sequence<I...>) -> std::array<std::uint8_t, sizeof...(I)> {
+      return {[]<class S>(const S& s) {
+        auto count = static_cast<std::uint8_t>(0);
+        for_each_stack(s, [&](std::size_t, std::size_t) { ++count; });
+        return count;
+      }(std::variant_alternative_t<I, state>{})...};
+    }
+
+    template <std::size_t... I>
+    auto make_state(std::size_t op, std::index_sequence<I...>) -> state {
+      static constexpr state table[] = {state{std::in_place_index<I>}...};
+      if (op >= sizeof...(I))
+        throw std::invalid_argument{"invalid opcode"};
+      return table[op];
+    }
+
+    template <class F>
+    auto emit_source(std::ostream& out, std::size_t n, std::size_t init, F state_at) -> void {
+      out << n << ' ' << (init + 1) << '\n';
+      for (auto i = static_cast<std::size_t>(0); i < n; ++i)
+        std::visit([&](const auto& s) { s.emit_source(out); }, state_at(i));
+    }
+
+    template <class F>
+    auto emit_c(std::ostream& out, std::size_t n, std::size_t init, const emit_options& options, F state_at) -> void {
+      auto max_stack = static_cast<std::size_t>(0);
+      auto kernels = runtime_kernels{};
+      for (auto i = static_cast<std::size_t>(0); i < n; ++i)
+        std::visit([&](const auto& s) {
+          using S = std::decay_t<decltype(s)>;
+          max_stack = std::max(max_stack, s.max_stack());
+          kernels.sort = kernels.sort || std::is_same_v<S, state_sort_ascending> || std::is_same_v<S, state_sort_descending>;
+          kernels.multiply_scalar = kernels.multiply_scalar || std::is_same_v<S, state_bulk_multiply>;
+          kernels.multiply_elementwise = kernels.multiply_elementwise || std::is_same_v<S, state_vector_multiply>;
+          kernels.prefix_sum = kernels.prefix_sum || std::is_same_v<S, state_prefix_sum>;
+          kernels.suffix_sum = kernels.suffix_sum || std::is_same_v<S, state_suffix_sum>;
+          kernels.finite_difference = kernels.finite_difference || std::is_same_v<S, state_finite_difference>;
+          kernels.sum = kernels.sum || std::is_same_v<S, state_sum>;
+          kernels.product = kernels.product || std::is_same_v<S, state_product>;
+          kernels.reverse = kernels.reverse || std::is_same_v<S, state_reverse>;
+          kernels.rotate = kernels.rotate || std::is_same_v<S, state_rotate>;
+          kernels.copy = kernels.copy || std::is_same_v<S, state_bulk_move> || std::is_same_v<S, state_bulk_copy>;
+        }, state_at(i));
+      if (!~max_stack)
+        throw std::invalid_argument{"too many stacks"};
+      if (!options.stack_capacity)
+        throw std::invalid_argument{"stack capacity must be positive"};
+      if (options.guard_pages && options.stack_capacity % guard_granularity)
+        throw std::invalid_argument{"stack capacity must be a multiple of " + std::to_string(guard_granularity) + " with guard pages"};
+      if (options.guard_pages && options.cache_top)
+        throw std::invalid_argument{"guard pages cannot be combined with top-of-stack caching"};
+      auto forms = std::vector<std::optional<closed_form>>(n);
+      if (options.closed_forms)
+        for (auto i = static_cast<std::size_t>(0); i < n; ++i)
+          if (std::holds_alternative<state_less>(state_at(i)))
+            forms[i] = find_closed_form(i, max_stack + 1, state_at);
+      if (!options.idioms.empty() && options.idioms.size() != n)
+        throw std::invalid_argument{"loop idioms do not match the program"};
+      auto idiom = [&](std::size_t i) {
+        return i < options.idioms.size() && !std::holds_alternative<std::monostate>(options.idioms[i]);
+      };
+      for (auto i = static_cast<std::size_t>(0); i < n; ++i)
+        if (idiom(i) && !std::holds_alternative<state_empty>(state_at(i)))
+          throw std::invalid_argument{"invalid loop idiom"};
+      auto chains = std::vector<std::vector<std::size_t>>(n);
+      auto member = std::vector<bool>(n);
+      if (!options.fused.empty()) {
+        if (options.guard_pages)
+          throw std::invalid_argument{"guard pages cannot be combined with fused states"};
+        if (options.fused.size() != n)
+          throw std::invalid_argument{"fused states do not match the program"};
+        for (auto i = static_cast<std::size_t>(0); i < n; ++i) {
+          auto next = options.fused[i];
+          if (!~next || forms[next] || idiom(next))
+            continue;
+          auto valid = next < n && next != init && !member[next] && std::visit([&](const auto& s) {
+            using S = std::decay_t<decltype(s)>;
+            if constexpr (is_fusable<S>) {
+              if constexpr (requires { operator_of(s); })
+                if ((operator_of(s) == '/' || operator_of(s) == '%') && (i >= options.hints.size() || options.hints[i].check_divisor()))
+                  return false;
+              return s.next == next;
+            } else
+              return false;
+          }, state_at(i)) && std::visit([](const auto& s) {
+            using S = std::decay_t<decltype(s)>;
+            return is_fusable<S> || ends_fusion<S>;
+          }, state_at(next));
+          if (!valid)
+            throw std::invalid_argument{"invalid fused state"};
+          member[next] = true;
+        }
+        auto fused = static_cast<std::size_t>(0);
+        for (auto i = static_cast<std::size_t>(0); i < n; ++i)
+          if (!member[i] && ~options.fused[i])
+            for (auto j = i; ~j && (j == i || (!forms[j] && !idiom(j))); j = options.fused[j]) {
+              chains[i].push_back(j);
+              fused += j != i;
+            }
+        if (fused != static_cast<std::size_t>(std::count(member.begin(), member.end(), true)))
+          throw std::invalid_argument{"fused states form a cycle"};
+      }
+      if (options.guard_pages)
+        emit_guard_prologue(out, max_stack + 1, options, kernels);
+      else {
+        out
+          << "#include <inttypes.h>\n"
+          << "#include <stdio.h>\n"
+          << "#include <stdlib.h>\n"
+          << "\n";
+        emit_runtime(out, options.stack_capacity, kernels);
+        out
+          << "int main(void) {\n";
+        if (options.cache_top) {
+          out
+            << "  static uint_least32_t storage[" << (max_stack + 1) << "][" << (options.stack_capacity + 1) << "];\n"
+            << "  uint_least32_t* stack[] = {\n";
+          for (auto i = static_cast<std::size_t>(0); i <= max_stack; ++i)
+            out
+              << "    storage[" << i << "] + 1,\n";
+          out
+            << "  };\n";
+        } else
+          out
+            << "  static uint_least32_t stack[" << (max_stack + 1) << "][" << options.stack_capacity << "];\n";
+      }
+      out
+        << "  uint_least32_t* top[] = {\n";
+      for (auto i = static_cast<std::size_t>(0); i <= max_stack; ++i)
+        out
+          << "    stack[" << i << "],\n";
+      out
+        << "  };\n";
+      if (options.cache_top)
+        for (auto i = static_cast<std::size_t>(0); i <= max_stack; ++i)
+          out
+            << "  uint_least32_t tos" << i << " = 0;\n";
+      if (options.count_dispatches)
+        out
+          << "  unsigned long long dispatches = 0;\n";
+      out
+        << "  for (uint_least32_t* ptr = *stack + " << options.stack_capacity << "; ;) {\n"
+        << "    uint_least32_t val;\n"
+        << "    switch (scanf(\"%\" SCNuLEAST32, &val)) {\n"
+        << "      case 1:\n"
+        << "        if (ptr == *stack)\n"
+        << "          return 1;\n"
+        << "        *--ptr = val % UINT32_C(" << modulo << ");\n"
+        << "        break;\n"
+        << "      case 0:\n"
+        << "        return 4;\n"
+        << "      case EOF:\n"
+        << "        while (ptr != *stack + " << options.stack_capacity << ")\n"
+        << "          *(*top)++ = *ptr++;\n";
+      if (options.cache_top)
+        out
+          << "        tos0 = (*top)[-1];\n";
+      out
+        << "        goto state_" << init << ";\n"
+        << "    }\n"
+        << "  }\n";
+      for (auto i = static_cast<std::size_t>(0); i < n; ++i) {
+        if (member[i])
+          continue;
+        out << "state_" << i << ":";
+        if (i < options.origin.size())
+          out << " /* state " << (options.origin[i] + 1) << " */";
+        out << '\n';
+        if (options.count_dispatches)
+          out << "  ++dispatches;\n";
+        if (forms[i])
+          emit_closed_form(out, options, i, *forms[i], state_at);
+        if (!chains[i].empty())
+          emit_fused(out, options, max_stack + 1, chains[i], state_at);
+        else if (idiom(i))
+          emit_loop_idiom(out, options, std::get<state_empty>(state_at(i)), options.idioms[i]);
+        else
+          std::visit([&](const auto& s) { s.emit_c(out, options, i < options.hints.size() ? options.hints[i] : emit_hints{}); }, state_at(i));
+      }
+      out
+        << "end:\n";
+      if (options.count_dispatches)
+        out
+          << "  fprintf(stderr, \"dispatches: %llu\\n\", dispatches);\n";
+      if (options.cache_top)
+        out
+          << "  top[0][-1] = tos0;\n";
+      out
+        << "  while (*top != *stack)\n"
+        << "    printf(\"%\" PRIuLEAST32 \"\\n\", *--*top);\n"
+        << "  return 0;\n"
+        << "}\n";
+    }
+  }
+
+  auto emit_hints::check_overflow(std::size_t s) const -> bool {
+    return s >= 8 || this->overflow >> s & 1;
+  }
+
+  auto emit_hints::check_underflow(std::size_t s) const -> bool {
+    return s >= 8 || this->underflow >> s & 1;
+  }
+
+  auto emit_hints::check_divisor() const -> bool {
+    return (!this->right || !*this->right || *this->right >= modulo) && !this->right_range.lo;
   }
 
   auto state_terminate::max_stack() const -> std::size_t {
@@ -26,7 +1582,7 @@ namespace ud2::luogu3 {
     out << "TER\n";
   }
 
-  auto state_terminate::emit_c(std::ostream& out) const -> void {
+  auto state_terminate::emit_c(std::ostream& out, const emit_options&, const emit_hints&) const -> void {
     out << "  goto end;\n";
   }
 
@@ -38,12 +1594,13 @@ namespace ud2::luogu3 {
     out << "PUS " << detail::source_name(this->target) << ' ' << this->val << ' ' << (this->next + 1) << '\n';
   }
 
-  auto state_push::emit_c(std::ostream& out) const -> void {
-    out
-      << "  if (top[" << this->target << "] == stack[" << this->target << "] + " << stack_capacity << ")\n"
-      << "    return 1;\n"
-      << "  *top[" << this->target << "]++ = UINT32_C(" << this->val << ");\n"
-      << "  goto state_" << this->next << ";\n";
+  auto state_push::emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void {
+    detail::emit_overflow_check(out, options, hints, this->target);
+    if (options.cache_top)
+      detail::emit_result(out, options, this->target, [&] { out << "UINT32_C(" << this->val << ")"; });
+    else
+      out << "  *top[" << this->target << "]++ = UINT32_C(" << this->val << ");\n";
+    out << "  goto state_" << this->next << ";\n";
   }
 
   auto state_pop::max_stack() const -> std::size_t {
@@ -54,12 +1611,12 @@ namespace ud2::luogu3 {
     out << "POP " << detail::source_name(this->target) << ' ' << (this->next + 1) << '\n';
   }
 
-  auto state_pop::emit_c(std::ostream& out) const -> void {
-    out
-      << "  if (top[" << this->target << "] == stack[" << this->target << "])\n"
-      << "    return 2;\n"
-      << "  --top[" << this->target << "];\n"
-      << "  goto state_" << this->next << ";\n";
+  auto state_pop::emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void {
+    detail::emit_underflow_check(out, options, hints, {this->target}, 2);
+    out << "  --top[" << this->target << "];\n";
+    if (options.cache_top)
+      out << "  tos" << this->target << " = top[" << this->target << "][-1];\n";
+    out << "  goto state_" << this->next << ";\n";
   }
 
   auto state_move::max_stack() const -> std::size_t {
@@ -67,19 +1624,28 @@ namespace ud2::luogu3 {
   }
 
   auto state_move::emit_source(std::ostream& out) const -> void {
-    out << "MOV" << detail::source_name(this->target) << ' ' << detail::source_name(this->from) << ' ' << (this->next + 1) << '\n';
+    out << "MOV " << detail::source_name(this->target) << ' ' << detail::source_name(this->from) << ' ' << (this->next + 1) << '\n';
   }
 
-  auto state_move::emit_c(std::ostream& out) -> void {
-    out
-      << "  if (top[" << this->target << "] == stack[" << this->target << "] + " << stack_capacity << ")\n"
-      << "    return 1;\n"
-      << "  if (top[" << this->from << "] == stack[" << this->from << "])\n"
-      << "    return 2;\n"
-      << "  --top[" << this->from << "];\n"
-      << "  *top[" << this->target << "] = *top[" << this->from << "];\n"
-      << "  ++top[" << this->target << "];\n"
-      << "  goto state_" << this->next << ";\n";
+  auto state_move::emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void {
+    detail::emit_overflow_check(out, options, hints, this->target);
+    detail::emit_underflow_check(out, options, hints, {this->from}, 2);
+    if (options.cache_top)
+      out
+        << "  {\n"
+        << "    uint_least32_t val = tos" << this->from << ";\n"
+        << "    --top[" << this->from << "];\n"
+        << "    tos" << this->from << " = top[" << this->from << "][-1];\n"
+        << "    top[" << this->target << "][-1] = tos" << this->target << ";\n"
+        << "    ++top[" << this->target << "];\n"
+        << "    tos" << this->target << " = val;\n"
+        << "  }\n";
+    else
+      out
+        << "  --top[" << this->from << "];\n"
+        << "  *top[" << this->target << "] = *top[" << this->from << "];\n"
+        << "  ++top[" << this->target << "];\n";
+    out << "  goto state_" << this->next << ";\n";
   }
 
   auto state_copy::max_stack() const -> std::size_t {
@@ -90,15 +1656,11 @@ namespace ud2::luogu3 {
     out << "CPY " << detail::source_name(this->target) << ' ' << detail::source_name(this->from) << ' ' << (this->next + 1) << '\n';
   }
 
-  auto state_copy::emit_c(std::ostream& out) -> void {
-    out
-      << "  if (top[" << this->target << "] == stack[" << this->target << "] + " << stack_capacity << ")\n"
-      << "    return 1;\n"
-      << "  if (top[" << this->from << "] == stack[" << this->from << "])\n"
-      << "    return 3;\n"
-      << "  *top[" << this->target << "] = top[" << this->from << "][-1];\n"
-      << "  ++top[" << this->target << "];\n"
-      << "  goto state_" << this->next << ";\n";
+  auto state_copy::emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void {
+    detail::emit_overflow_check(out, options, hints, this->target);
+    detail::emit_underflow_check(out, options, hints, {this->from}, 3);
+    detail::emit_result(out, options, this->target, [&] { out << detail::operand{std::nullopt, this->from, options.cache_top}; });
+    out << "  goto state_" << this->next << ";\n";
   }
 
   auto state_add::max_stack() const -> std::size_t {
@@ -109,15 +1671,8 @@ namespace ud2::luogu3 {
     out << "ADD " << detail::source_name(this->target) << ' ' << detail::source_name(this->left) << ' ' << detail::source_name(this->right) << ' ' << (this->next + 1) << '\n';
   }
 
-  auto state_add::emit_c(std::ostream& out) -> void {
-    out
-      << "  if (top[" << this->target << "] == stack[" << this->target << "] + " << stack_capacity << ")\n"
-      << "    return 1;\n"
-      << "  if (top[" << this->left << "] == stack[" << this->left << "] || top[" << this->right << "] == stack[" << this->right << "])\n"
-      << "    return 3;\n"
-      << "  *top[" << this->target << "] = (uint_least32_t) (((uint_least64_t) top[" << this->left << "][-1] + top[" << this->right << "][-1]) % UINT32_C(" << modulo << "));\n"
-      << "  ++top[" << this->target << "];\n"
-      << "  goto state_" << this->next << ";\n";
+  auto state_add::emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void {
+    detail::emit_arithmetic(out, options, hints, *this);
   }
 
   auto state_subtract::max_stack() const -> std::size_t {
@@ -128,15 +1683,8 @@ namespace ud2::luogu3 {
     out << "SUB " << detail::source_name(this->target) << ' ' << detail::source_name(this->left) << ' ' << detail::source_name(this->right) << ' ' << (this->next + 1) << '\n';
   }
 
-  auto state_subtract::emit_c(std::ostream& out) -> void {
-    out
-      << "  if (top[" << this->target << "] == stack[" << this->target << "] + " << stack_capacity << ")\n"
-      << "    return 1;\n"
-      << "  if (top[" << this->left << "] == stack[" << this->left << "] || top[" << this->right << "] == stack[" << this->right << "])\n"
-      << "    return 3;\n"
-      << "  *top[" << this->target << "] = (uint_least32_t) ((UINT64_C(" << modulo << ") + top[" << this->left << "][-1] - top[" << this->right << "][-1]) % UINT32_C(" << modulo << "));\n"
-      << "  ++top[" << this->target << "];\n"
-      << "  goto state_" << this->next << ";\n";
+  auto state_subtract::emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void {
+    detail::emit_arithmetic(out, options, hints, *this);
   }
 
   auto state_multiply::max_stack() const -> std::size_t {
@@ -147,15 +1695,8 @@ namespace ud2::luogu3 {
     out << "MUL " << detail::source_name(this->target) << ' ' << detail::source_name(this->left) << ' ' << detail::source_name(this->right) << ' ' << (this->next + 1) << '\n';
   }
 
-  auto state_multiply::emit_c(std::ostream& out) -> void {
-    out
-      << "  if (top[" << this->target << "] == stack[" << this->target << "] + " << stack_capacity << ")\n"
-      << "    return 1;\n"
-      << "  if (top[" << this->left << "] == stack[" << this->left << "] || top[" << this->right << "] == stack[" << this->right << "])\n"
-      << "    return 3;\n"
-      << "  *top[" << this->target << "] = (uint_least32_t) (((uint_least64_t) top[" << this->left << "][-1] * top[" << this->right << "][-1]) % UINT32_C(" << modulo << "));\n"
-      << "  ++top[" << this->target << "];\n"
-      << "  goto state_" << this->next << ";\n";
+  auto state_multiply::emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void {
+    detail::emit_arithmetic(out, options, hints, *this);
   }
 
   auto state_divide::max_stack() const -> std::size_t {
@@ -166,17 +1707,8 @@ namespace ud2::luogu3 {
     out << "DIV " << detail::source_name(this->target) << ' ' << detail::source_name(this->left) << ' ' << detail::source_name(this->right) << ' ' << (this->next + 1) << '\n';
   }
 
-  auto state_divide::emit_c(std::ostream& out) -> void {
-    out
-      << "  if (top[" << this->target << "] == stack[" << this->target << "] + " << stack_capacity << ")\n"
-      << "    return 1;\n"
-      << "  if (top[" << this->left << "] == stack[" << this->left << "] || top[" << this->right << "] == stack[" << this->right << "])\n"
-      << "    return 3;\n"
-      << "  if (top[" << this->right << "][-1] == 0)\n"
-      << "    return 4;\n"
-      << "  *top[" << this->target << "] = top[" << this->left << "][-1] / top[" << this->right << "][-1];\n"
-      << "  ++top[" << this->target << "];\n"
-      << "  goto state_" << this->next << ";\n";
+  auto state_divide::emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void {
+    detail::emit_arithmetic(out, options, hints, *this);
   }
 
   auto state_modulo::max_stack() const -> std::size_t {
@@ -187,17 +1719,8 @@ namespace ud2::luogu3 {
     out << "MOD " << detail::source_name(this->target) << ' ' << detail::source_name(this->left) << ' ' << detail::source_name(this->right) << ' ' << (this->next + 1) << '\n';
   }
 
-  auto state_modulo::emit_c(std::ostream& out) -> void {
-    out
-      << "  if (top[" << this->target << "] == stack[" << this->target << "] + " << stack_capacity << ")\n"
-      << "    return 1;\n"
-      << "  if (top[" << this->left << "] == stack[" << this->left << "] || top[" << this->right << "] == stack[" << this->right << "])\n"
-      << "    return 3;\n"
-      << "  if (top[" << this->right << "][-1] == 0)\n"
-      << "    return 4;\n"
-      << "  *top[" << this->target << "] = top[" << this->left << "][-1] % top[" << this->right << "][-1];\n"
-      << "  ++top[" << this->target << "];\n"
-      << "  goto state_" << this->next << ";\n";
+  auto state_modulo::emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void {
+    detail::emit_arithmetic(out, options, hints, *this);
   }
 
   auto state_empty::max_stack() const -> std::size_t {
@@ -208,7 +1731,11 @@ namespace ud2::luogu3 {
     out << "EMP " << detail::source_name(this->target) << ' ' << (this->consequent + 1) << ' ' << (this->alternative + 1) << '\n';
   }
 
-  auto state_empty::emit_c(std::ostream& out) const -> void {
+  auto state_empty::emit_c(std::ostream& out, const emit_options&, const emit_hints&) const -> void {
+    if (this->consequent == this->alternative) {
+      out << "  goto state_" << this->consequent << ";\n";
+      return;
+    }
     out
       << "  if (top[" << this->target << "] == stack[" << this->target << "])\n"
       << "    goto state_" << this->consequent << ";\n"
@@ -224,11 +1751,10 @@ namespace ud2::luogu3 {
     out << "CMP " << detail::source_name(this->right) << ' ' << detail::source_name(this->left) << ' ' << (this->alternative + 1) << ' ' << (this->consequent + 1) << '\n';
   }
 
-  auto state_less::emit_c(std::ostream& out) const -> void {
+  auto state_less::emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void {
+    detail::emit_underflow_check(out, options, hints, {this->left, this->right}, 3);
     out
-      << "  if (top[" << this->left << "] == stack[" << this->left << "] || top[" << this->right << "] == stack[" << this->right << "])\n"
-      << "    return 3;\n"
-      << "  if (top[" << this->left << "][-1] < top[" << this->right << "][-1])\n"
+      << "  if (" << detail::operand{hints.left, this->left, options.cache_top} << " < " << detail::operand{hints.right, this->right, options.cache_top} << ")\n"
       << "    goto state_" << this->consequent << ";\n"
       << "  else\n"
       << "    goto state_" << this->alternative << ";\n";
@@ -242,17 +1768,14 @@ namespace ud2::luogu3 {
     out << "T00 " << detail::source_name(this->target) << ' ' << (this->next + 1) << '\n';
   }
 
-  auto state_prefix_sum::emit_c(std::ostream& out) const -> void {
+  auto state_prefix_sum::emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void {
+    detail::emit_underflow_check(out, options, hints, {this->target}, 3);
     out
-      << "  if (top[" << this->target << "] == stack[" << this->target << "])\n"
-      << "    return 3;\n"
       << "  {\n"
-      << "    uint_least32_t k = top[" << this->target << "][-1];\n"
+      << "    uint_least32_t k = " << detail::operand{std::nullopt, this->target, options.cache_top} << ";\n"
       << "    if (top[" << this->target << "] - 1 - stack[" << this->target << "] < k)\n"
       << "      return 3;\n"
-      << "    uint_least32_t* ptr = top[" << this->target << "] - 1 - k;\n"
-      << "    for (uint_least32_t i = 1; i < k; ++i)\n"
-      << "      ptr[k - i - 1] += ptr[k - i];\n"
+      << "    prefix_sum(top[" << this->target << "] - 1 - k, k);\n"
       << "  }\n"
       << "  goto state_" << this->next << ";\n";
   }
@@ -265,17 +1788,14 @@ namespace ud2::luogu3 {
     out << "T01 " << detail::source_name(this->target) << ' ' << (this->next + 1) << '\n';
   }
 
-  auto state_suffix_sum::emit_c(std::ostream& out) const -> void {
+  auto state_suffix_sum::emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void {
+    detail::emit_underflow_check(out, options, hints, {this->target}, 3);
     out
-      << "  if (top[" << this->target << "] == stack[" << this->target << "])\n"
-      << "    return 3;\n"
       << "  {\n"
-      << "    uint_least32_t k = top[" << this->target << "][-1];\n"
+      << "    uint_least32_t k = " << detail::operand{std::nullopt, this->target, options.cache_top} << ";\n"
       << "    if (top[" << this->target << "] - 1 - stack[" << this->target << "] < k)\n"
       << "      return 3;\n"
-      << "    uint_least32_t* ptr = top[" << this->target << "] - 1 - k;\n"
-      << "    for (uint_least32_t i = 1; i < k; ++i)\n"
-      << "      ptr[i] += ptr[i - 1];\n"
+      << "    suffix_sum(top[" << this->target << "] - 1 - k, k);\n"
       << "  }\n"
       << "  goto state_" << this->next << ";\n";
   }
@@ -288,17 +1808,14 @@ namespace ud2::luogu3 {
     out << "T02 " << detail::source_name(this->target) << ' ' << (this->next + 1) << '\n';
   }
 
-  auto state_finite_difference::emit_c(std::ostream& out) const -> void {
+  auto state_finite_difference::emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void {
+    detail::emit_underflow_check(out, options, hints, {this->target}, 3);
     out
-      << "  if (top[" << this->target << "] == stack[" << this->target << "])\n"
-      << "    return 3;\n"
       << "  {\n"
-      << "    uint_least32_t k = top[" << this->target << "][-1];\n"
+      << "    uint_least32_t k = " << detail::operand{std::nullopt, this->target, options.cache_top} << ";\n"
       << "    if (top[" << this->target << "] - 1 - stack[" << this->target << "] < k)\n"
       << "      return 3;\n"
-      << "    uint_least32_t* ptr = top[" << this->target << "] - 1 - k;\n"
-      << "    for (uint_least32_t i = 1; i < k; ++i)\n"
-      << "      ptr[i - 1] -= ptr[i];\n"
+      << "    finite_difference(top[" << this->target << "] - 1 - k, k);\n"
       << "  }\n"
       << "  goto state_" << this->next << ";\n";
   }
@@ -311,10 +1828,16 @@ namespace ud2::luogu3 {
     out << "T03 " << detail::source_name(this->target) << ' ' << (this->next + 1) << '\n';
   }
 
-  auto state_reverse::emit_c(std::ostream& out) const -> void {
+  auto state_reverse::emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void {
+    detail::emit_underflow_check(out, options, hints, {this->target}, 3);
     out
-      << "  fputs(\"unimplemented\\n\", stderr);\n"
-      << "  abort();\n";
+      << "  {\n"
+      << "    uint_least32_t k = " << detail::operand{std::nullopt, this->target, options.cache_top} << ";\n"
+      << "    if (top[" << this->target << "] - 1 - stack[" << this->target << "] < k)\n"
+      << "      return 3;\n"
+      << "    reverse_segment(top[" << this->target << "] - 1 - k, k);\n"
+      << "  }\n"
+      << "  goto state_" << this->next << ";\n";
   }
 
   auto state_sort_ascending::max_stack() const -> std::size_t {
@@ -325,10 +1848,16 @@ namespace ud2::luogu3 {
     out << "T04 " << detail::source_name(this->target) << ' ' << (this->next + 1) << '\n';
   }
 
-  auto state_sort_ascending::emit_c(std::ostream& out) const -> void {
+  auto state_sort_ascending::emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void {
+    detail::emit_underflow_check(out, options, hints, {this->target}, 3);
     out
-      << "  fputs(\"unimplemented\\n\", stderr);\n"
-      << "  abort();\n";
+      << "  {\n"
+      << "    uint_least32_t k = " << detail::operand{std::nullopt, this->target, options.cache_top} << ";\n"
+      << "    if (top[" << this->target << "] - 1 - stack[" << this->target << "] < k)\n"
+      << "      return 3;\n"
+      << "    sort_segment(top[" << this->target << "] - 1 - k, k, 1);\n"
+      << "  }\n"
+      << "  goto state_" << this->next << ";\n";
   }
 
   auto state_sort_descending::max_stack() const -> std::size_t {
@@ -339,10 +1868,16 @@ namespace ud2::luogu3 {
     out << "T05 " << detail::source_name(this->target) << ' ' << (this->next + 1) << '\n';
   }
 
-  auto state_sort_descending::emit_c(std::ostream& out) const -> void {
+  auto state_sort_descending::emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void {
+    detail::emit_underflow_check(out, options, hints, {this->target}, 3);
     out
-      << "  fputs(\"unimplemented\\n\", stderr);\n"
-      << "  abort();\n";
+      << "  {\n"
+      << "    uint_least32_t k = " << detail::operand{std::nullopt, this->target, options.cache_top} << ";\n"
+      << "    if (top[" << this->target << "] - 1 - stack[" << this->target << "] < k)\n"
+      << "      return 3;\n"
+      << "    sort_segment(top[" << this->target << "] - 1 - k, k, 0);\n"
+      << "  }\n"
+      << "  goto state_" << this->next << ";\n";
   }
 
   auto state_rotate::max_stack() const -> std::size_t {
@@ -353,10 +1888,16 @@ namespace ud2::luogu3 {
     out << "T06 " << detail::source_name(this->target) << ' ' << detail::source_name(this->count) << ' ' << (this->next + 1) << '\n';
   }
 
-  auto state_rotate::emit_c(std::ostream& out) const -> void {
+  auto state_rotate::emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void {
+    detail::emit_underflow_check(out, options, hints, {this->target, this->count}, 3);
     out
-      << "  fputs(\"unimplemented\\n\", stderr);\n"
-      << "  abort();\n";
+      << "  {\n"
+      << "    uint_least32_t k = " << detail::operand{std::nullopt, this->target, options.cache_top} << ";\n"
+      << "    if (top[" << this->target << "] - 1 - stack[" << this->target << "] < k)\n"
+      << "      return 3;\n"
+      << "    rotate_segment(top[" << this->target << "] - 1 - k, k, " << detail::operand{std::nullopt, this->count, options.cache_top} << ");\n"
+      << "  }\n"
+      << "  goto state_" << this->next << ";\n";
   }
 
   auto state_bulk_move::max_stack() const -> std::size_t {
@@ -367,10 +1908,8 @@ namespace ud2::luogu3 {
     out << "T07 " << detail::source_name(this->target) << ' ' << detail::source_name(this->from) << ' ' << (this->next + 1) << '\n';
   }
 
-  auto state_bulk_move::emit_c(std::ostream& out) const -> void {
-    out
-      << "  fputs(\"unimplemented\\n\", stderr);\n"
-      << "  abort();\n";
+  auto state_bulk_move::emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void {
+    detail::emit_bulk_transfer(out, options, hints, *this);
   }
 
   auto state_bulk_copy::max_stack() const -> std::size_t {
@@ -381,10 +1920,8 @@ namespace ud2::luogu3 {
     out << "T08 " << detail::source_name(this->target) << ' ' << detail::source_name(this->from) << ' ' << (this->next + 1) << '\n';
   }
 
-  auto state_bulk_copy::emit_c(std::ostream& out) const -> void {
-    out
-      << "  fputs(\"unimplemented\\n\", stderr);\n"
-      << "  abort();\n";
+  auto state_bulk_copy::emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void {
+    detail::emit_bulk_transfer(out, options, hints, *this);
   }
 
   auto state_fill::max_stack() const -> std::size_t {
@@ -395,7 +1932,7 @@ namespace ud2::luogu3 {
     out << "T09 " << detail::source_name(this->target) << ' ' << detail::source_name(this->from) << ' ' << (this->next + 1) << '\n';
   }
 
-  auto state_fill::emit_c(std::ostream& out) const -> void {
+  auto state_fill::emit_c(std::ostream& out, const emit_options&, const emit_hints&) const -> void {
     out
       << "  fputs(\"unimplemented\\n\", stderr);\n"
       << "  abort();\n";
@@ -409,7 +1946,7 @@ namespace ud2::luogu3 {
     out << "T10 " << detail::source_name(this->target) << ' ' << detail::source_name(this->from) << ' ' << (this->next + 1) << '\n';
   }
 
-  auto state_iota::emit_c(std::ostream& out) const -> void {
+  auto state_iota::emit_c(std::ostream& out, const emit_options&, const emit_hints&) const -> void {
     out
       << "  fputs(\"unimplemented\\n\", stderr);\n"
       << "  abort();\n";
@@ -423,10 +1960,8 @@ namespace ud2::luogu3 {
     out << "T11 " << detail::source_name(this->target) << ' ' << detail::source_name(this->from) << ' ' << (this->next + 1) << '\n';
   }
 
-  auto state_sum::emit_c(std::ostream& out) const -> void {
-    out
-      << "  fputs(\"unimplemented\\n\", stderr);\n"
-      << "  abort();\n";
+  auto state_sum::emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void {
+    detail::emit_reduction(out, options, hints, *this, "sum_segment");
   }
 
   auto state_product::max_stack() const -> std::size_t {
@@ -437,10 +1972,8 @@ namespace ud2::luogu3 {
     out << "T12 " << detail::source_name(this->target) << ' ' << detail::source_name(this->from) << ' ' << (this->next + 1) << '\n';
   }
 
-  auto state_product::emit_c(std::ostream& out) const -> void {
-    out
-      << "  fputs(\"unimplemented\\n\", stderr);\n"
-      << "  abort();\n";
+  auto state_product::emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void {
+    detail::emit_reduction(out, options, hints, *this, "product_segment");
   }
 
   auto state_bulk_add::max_stack() const -> std::size_t {
@@ -451,7 +1984,7 @@ namespace ud2::luogu3 {
     out << "T14 " << detail::source_name(this->target) << ' ' << detail::source_name(this->from) << ' ' << (this->next + 1) << '\n';
   }
 
-  auto state_bulk_add::emit_c(std::ostream& out) const -> void {
+  auto state_bulk_add::emit_c(std::ostream& out, const emit_options&, const emit_hints&) const -> void {
     out
       << "  fputs(\"unimplemented\\n\", stderr);\n"
       << "  abort();\n";
@@ -465,7 +1998,7 @@ namespace ud2::luogu3 {
     out << "T15 " << detail::source_name(this->target) << ' ' << detail::source_name(this->from) << ' ' << (this->next + 1) << '\n';
   }
 
-  auto state_bulk_subtract::emit_c(std::ostream& out) const -> void {
+  auto state_bulk_subtract::emit_c(std::ostream& out, const emit_options&, const emit_hints&) const -> void {
     out
       << "  fputs(\"unimplemented\\n\", stderr);\n"
       << "  abort();\n";
@@ -479,10 +2012,16 @@ namespace ud2::luogu3 {
     out << "T16 " << detail::source_name(this->target) << ' ' << detail::source_name(this->from) << ' ' << (this->next + 1) << '\n';
   }
 
-  auto state_bulk_multiply::emit_c(std::ostream& out) const -> void {
+  auto state_bulk_multiply::emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void {
+    detail::emit_underflow_check(out, options, hints, {this->target, this->from}, 3);
     out
-      << "  fputs(\"unimplemented\\n\", stderr);\n"
-      << "  abort();\n";
+      << "  {\n"
+      << "    uint_least32_t k = " << detail::operand{std::nullopt, this->target, options.cache_top} << ";\n"
+      << "    if (top[" << this->target << "] - 1 - stack[" << this->target << "] < k)\n"
+      << "      return 3;\n"
+      << "    multiply_scalar(top[" << this->target << "] - 1 - k, k, " << detail::operand{std::nullopt, this->from, options.cache_top} << ");\n"
+      << "  }\n"
+      << "  goto state_" << this->next << ";\n";
   }
 
   auto state_bulk_divide::max_stack() const -> std::size_t {
@@ -493,7 +2032,7 @@ namespace ud2::luogu3 {
     out << "T17 " << detail::source_name(this->target) << ' ' << detail::source_name(this->from) << ' ' << (this->next + 1) << '\n';
   }
 
-  auto state_bulk_divide::emit_c(std::ostream& out) const -> void {
+  auto state_bulk_divide::emit_c(std::ostream& out, const emit_options&, const emit_hints&) const -> void {
     out
       << "  fputs(\"unimplemented\\n\", stderr);\n"
       << "  abort();\n";
@@ -507,7 +2046,7 @@ namespace ud2::luogu3 {
     out << "T18 " << detail::source_name(this->target) << ' ' << detail::source_name(this->from) << ' ' << (this->next + 1) << '\n';
   }
 
-  auto state_bulk_modulo::emit_c(std::ostream& out) const -> void {
+  auto state_bulk_modulo::emit_c(std::ostream& out, const emit_options&, const emit_hints&) const -> void {
     out
       << "  fputs(\"unimplemented\\n\", stderr);\n"
       << "  abort();\n";
@@ -521,7 +2060,7 @@ namespace ud2::luogu3 {
     out << "T19 " << detail::source_name(this->target) << ' ' << detail::source_name(this->left) << ' ' << detail::source_name(this->right) << ' ' << (this->next + 1) << '\n';
   }
 
-  auto state_vector_add::emit_c(std::ostream& out) const -> void {
+  auto state_vector_add::emit_c(std::ostream& out, const emit_options&, const emit_hints&) const -> void {
     out
       << "  fputs(\"unimplemented\\n\", stderr);\n"
       << "  abort();\n";
@@ -535,7 +2074,7 @@ namespace ud2::luogu3 {
     out << "T20 " << detail::source_name(this->target) << ' ' << detail::source_name(this->left) << ' ' << detail::source_name(this->right) << ' ' << (this->next + 1) << '\n';
   }
 
-  auto state_vector_subtract::emit_c(std::ostream& out) const -> void {
+  auto state_vector_subtract::emit_c(std::ostream& out, const emit_options&, const emit_hints&) const -> void {
     out
       << "  fputs(\"unimplemented\\n\", stderr);\n"
       << "  abort();\n";
@@ -549,64 +2088,131 @@ namespace ud2::luogu3 {
     out << "T21 " << detail::source_name(this->target) << ' ' << detail::source_name(this->left) << ' ' << detail::source_name(this->right) << ' ' << (this->next + 1) << '\n';
   }
 
-  auto state_vector_multiply::emit_c(std::ostream& out) const -> void {
+  auto state_vector_multiply::emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void {
+    detail::emit_underflow_check(out, options, hints, {this->target, this->left, this->right}, 3);
     out
-      << "  fputs(\"unimplemented\\n\", stderr);\n"
-      << "  abort();\n";
+      << "  {\n"
+      << "    uint_least32_t k = " << detail::operand{std::nullopt, this->target, options.cache_top} << ";\n"
+      << "    if (top[" << this->target << "] - 1 - stack[" << this->target << "] < k || top[" << this->left << "] - 1 - stack[" << this->left << "] < k || top[" << this->right << "] - 1 - stack[" << this->right << "] < k)\n"
+      << "      return 3;\n"
+      << "    multiply_elementwise(top[" << this->target << "] - 1 - k, top[" << this->left << "] - 1 - k, top[" << this->right << "] - 1 - k, k);\n"
+      << "  }\n"
+      << "  goto state_" << this->next << ";\n";
   }
 
   auto program::emit_source(std::ostream& out) const -> void {
-    out << this->states.size() << ' ' << (this->init + 1) << '\n';
-    for (const auto& state : this->states)
-      std::visit([&](auto s) { s.emit_source(out); }, state);
+    detail::emit_source(out, this->states.size(), this->init, [&](std::size_t i) -> const state& { return this->states[i]; });
+  }
+
+  auto emit_runtime(std::ostream& out, std::size_t capacity, const runtime_kernels& kernels) -> void {
+    if (kernels.sort)
+      detail::emit_sort_runtime(out, capacity);
+    if (kernels.multiply_elementwise || kernels.product)
+      detail::emit_montgomery_runtime(out);
+    if (kernels.multiply_scalar || kernels.multiply_elementwise)
+      detail::emit_multiply_runtime(out, kernels);
+    if (kernels.sum || kernels.product)
+      detail::emit_reduce_runtime(out, kernels);
+    if (kernels.reverse || kernels.rotate || kernels.copy)
+      detail::emit_movement_runtime(out, kernels);
+    if (kernels.prefix_sum || kernels.suffix_sum || kernels.finite_difference)
+      detail::emit_scan_runtime(out, kernels);
+  }
+
+  auto program::emit_c(std::ostream& out, const emit_options& options) const -> void {
+    detail::emit_c(out, this->states.size(), this->init, options, [&](std::size_t i) -> const state& { return this->states[i]; });
+  }
+
+  auto packed_program::size() const -> std::size_t {
+    return this->ops.size();
+  }
+
+  auto packed_program::state_at(std::size_t i) const -> state {
+    auto result = detail::make_state(this->ops[i], std::make_index_sequence<std::variant_size_v<state>>{});
+    std::visit([&](auto& s) {
+      detail::for_each_stack(s, [&](std::size_t j, std::size_t& stack) { stack = this->stacks[i][j]; });
+      if constexpr (requires { s.val; })
+        s.val = this->vals[i];
+      detail::for_each_successor(s, [&](std::size_t j, std::size_t& next) { next = this->successors[i][j]; });
+    }, result);
+    return result;
+  }
+
+  auto packed_program::emit_source(std::ostream& out) const -> void {
+    static constexpr auto operands = detail::stack_operands(std::make_index_sequence<std::variant_size_v<state>>{});
+    out << this->size() << ' ' << (this->init + 1) << '\n';
+    for (auto i = static_cast<std::size_t>(0); i < this->size(); ++i) {
+      auto op = this->ops[i];
+      const auto& stacks = this->stacks[i];
+      const auto& next = this->successors[i];
+      if (op >= operands.size())
+        throw std::invalid_argument{"invalid opcode"};
+      out << detail::mnemonics[op];
+      switch (op) {
+        case detail::opcode<state_terminate>():
+          break;
+        case detail::opcode<state_push>():
+          out << ' ' << detail::source_name(stacks[0]) << ' ' << this->vals[i] << ' ' << (next[0] + 1);
+          break;
+        case detail::opcode<state_empty>():
+          out << ' ' << detail::source_name(stacks[0]) << ' ' << (next[0] + 1) << ' ' << (next[1] + 1);
+          break;
+        case detail::opcode<state_less>():
+          out << ' ' << detail::source_name(stacks[1]) << ' ' << detail::source_name(stacks[0]) << ' ' << (next[1] + 1) << ' ' << (next[0] + 1);
+          break;
+        default:
+          for (auto j = 0; j < operands[op]; ++j)
+            out << ' ' << detail::source_name(stacks[j]);
+          out << ' ' << (next[0] + 1);
+          break;
+      }
+      out << '\n';
+    }
   }
 
-  auto program::emit_c(std::ostream& out) const -> void {
-    auto max_stack = static_cast<std::size_t>(0);
-    for (const auto& state : this->states)
-      std::visit([&](auto s) { max_stack = std::max(max_stack, s.max_stack()); }, state);
-    if (!~max_stack)
-      throw std::invalid_argument{"too many stacks"};
-    out
-      << "#include <inttypes.h>\n"
-      << "#include <stdio.h>\n"
-      << "#include <stdlib.h>\n"
-      << "\n"
-      << "int main(void) {\n"
-      << "  static uint_least32_t stack[" << (max_stack + 1) << "][" << stack_capacity << "];\n"
-      << "  uint_least32_t* top[] = {\n";
-    for (auto i = static_cast<std::size_t>(0); i <= max_stack; ++i)
-      out
-        << "    stack[" << i << "],\n";
-    out
-      << "  };\n"
-      << "  for (uint_least32_t* ptr = *stack + " << stack_capacity << "; ;) {\n"
-      << "    uint_least32_t val;\n"
-      << "    switch (scanf(\"%\" SCNuLEAST32, &val)) {\n"
-      << "      case 1:\n"
-      << "        if (ptr == *stack)\n"
-      << "          return 1;\n"
-      << "        *--ptr = val % UINT32_C(" << modulo << ");\n"
-      << "        break;\n"
-      << "      case 0:\n"
-      << "        return 4;\n"
-      << "      case EOF:\n"
-      << "        while (ptr != *stack + " << stack_capacity << ")\n"
-      << "          *(*top)++ = *ptr++;\n"
-      << "        goto state_" << this->init << ";\n"
-      << "    }\n"
-      << "  }\n";
-    auto n = this->states.size();
+  auto packed_program::emit_c(std::ostream& out, const emit_options& options) const -> void {
+    detail::emit_c(out, this->size(), this->init, options, [&](std::size_t i) { return this->state_at(i); });
+  }
+
+  auto pack(const program& prog) -> packed_program {
+    auto n = prog.states.size();
+    if (n >= packed_program::none)
+      throw std::invalid_argument{"too many states"};
+    auto packed = packed_program{};
+    packed.ops.assign(n, 0);
+    packed.stacks.assign(n, {});
+    packed.vals.assign(n, 0);
+    packed.successors.assign(n, {packed_program::none, packed_program::none});
+    packed.init = static_cast<std::uint32_t>(prog.init);
     for (auto i = static_cast<std::size_t>(0); i < n; ++i) {
-      const auto& state = this->states[i];
-      out << "state_" << i << ":\n";
-      std::visit([&](auto s) { s.emit_c(out); }, state);
+      const auto& state = prog.states[i];
+      packed.ops[i] = static_cast<std::uint8_t>(state.index());
+      std::visit([&](const auto& s) {
+        detail::for_each_stack(s, [&](std::size_t j, std::size_t stack) {
+          if (stack > UINT8_MAX)
+            throw std::invalid_argument{"unrepresentable stack"};
+          packed.stacks[i][j] = static_cast<std::uint8_t>(stack);
+        });
+        if constexpr (requires { s.val; })
+          packed.vals[i] = s.val;
+        detail::for_each_successor(s, [&](std::size_t j, std::size_t next) {
+          if (next >= packed_program::none)
+            throw std::invalid_argument{"unrepresentable state"};
+          packed.successors[i][j] = static_cast<std::uint32_t>(next);
+        });
+      }, state);
     }
-    out
-      << "end:\n"
-      << "  while (*top != *stack)\n"
-      << "    printf(\"%\" PRIuLEAST32 \"\\n\", *--*top);\n"
-      << "  return 0;\n"
-      << "}\n";
+    return packed;
+  }
+
+  auto unpack(const packed_program& packed) -> program {
+    auto n = packed.size();
+    auto prog = program{};
+    prog.states.clear();
+    prog.states.reserve(n);
+    for (auto i = static_cast<std::size_t>(0); i < n; ++i)
+      prog.states.push_back(packed.state_at(i));
+    prog.init = packed.init;
+    return prog;
   }
 }
@@ -2,9 +2,12 @@
 #define LUOGU3_PROGRAM_HPP
 
 #include <algorithm>
+#include <array>
 #include <cstddef>
 #include <cstdint>
 #include <iosfwd>
+#include <optional>
+#include <span>
 #include <variant>
 #include <vector>
 
@@ -12,11 +15,59 @@ namespace ud2::luogu3 {
   constexpr auto max_states = static_cast<std::size_t>(100000);
   constexpr auto stack_capacity = static_cast<std::size_t>(1000000);
   constexpr auto modulo = UINT32_C(998244353);
+  constexpr auto guard_granularity = static_cast<std::size_t>(16384);
+  constexpr auto sort_insertion_cutoff = 32;
+  constexpr auto sort_wide_radix_from = 4096;
+
+  struct value_range {
+    std::uint_least32_t lo = 0;
+    std::uint_least32_t hi = modulo - 1;
+  };
+
+  struct emit_hints {
+    std::uint_least8_t overflow = 0xff;
+    std::uint_least8_t underflow = 0xff;
+    std::optional<std::uint_least32_t> left;
+    std::optional<std::uint_least32_t> right;
+    value_range left_range;
+    value_range right_range;
+    auto check_overflow(std::size_t s) const -> bool;
+    auto check_underflow(std::size_t s) const -> bool;
+    auto check_divisor() const -> bool;
+  };
+
+  // Bulk replacements for a loop headed by EMP X: loop_drain moves the
+  // elements of X onto target in reverse order, loop_clear empties X and
+  // loop_fill pushes val onto target once per element of X and empties X.
+  struct loop_drain {
+    std::size_t target;
+  };
+
+  struct loop_clear {};
+
+  struct loop_fill {
+    std::size_t target;
+    std::uint_least32_t val;
+  };
+
+  using loop_idiom = std::variant<std::monostate, loop_drain, loop_clear, loop_fill>;
+
+  struct emit_options {
+    std::size_t stack_capacity = luogu3::stack_capacity;
+    bool guard_pages = false;
+    bool cache_top = false;
+    bool closed_forms = false;
+    bool count_dispatches = false;
+    std::span<const std::size_t> origin;
+    std::span<const emit_hints> hints;
+    std::span<const std::size_t> fused;
+    std::span<const loop_idiom> idioms;
+  };
 
   struct state_terminate {
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) const -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_push {
@@ -25,7 +76,7 @@ namespace ud2::luogu3 {
     std::size_t next;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) const -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_pop {
@@ -33,7 +84,7 @@ namespace ud2::luogu3 {
     std::size_t next;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) const -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_move {
@@ -42,7 +93,7 @@ namespace ud2::luogu3 {
     std::size_t next;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_copy {
@@ -51,7 +102,7 @@ namespace ud2::luogu3 {
     std::size_t next;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_add {
@@ -61,7 +112,7 @@ namespace ud2::luogu3 {
     std::size_t next;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_subtract {
@@ -71,7 +122,7 @@ namespace ud2::luogu3 {
     std::size_t next;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_multiply {
@@ -81,7 +132,7 @@ namespace ud2::luogu3 {
     std::size_t next;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_divide {
@@ -91,7 +142,7 @@ namespace ud2::luogu3 {
     std::size_t next;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_modulo {
@@ -101,7 +152,7 @@ namespace ud2::luogu3 {
     std::size_t next;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_empty {
@@ -110,7 +161,7 @@ namespace ud2::luogu3 {
     std::size_t alternative;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) const -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_less {
@@ -120,7 +171,7 @@ namespace ud2::luogu3 {
     std::size_t alternative;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) const -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_prefix_sum {
@@ -128,7 +179,7 @@ namespace ud2::luogu3 {
     std::size_t next;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) const -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_suffix_sum {
@@ -136,7 +187,7 @@ namespace ud2::luogu3 {
     std::size_t next;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) const -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_finite_difference {
@@ -144,7 +195,7 @@ namespace ud2::luogu3 {
     std::size_t next;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) const -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_reverse {
@@ -152,7 +203,7 @@ namespace ud2::luogu3 {
     std::size_t next;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) const -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_sort_ascending {
@@ -160,7 +211,7 @@ namespace ud2::luogu3 {
     std::size_t next;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) const -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_sort_descending {
@@ -168,7 +219,7 @@ namespace ud2::luogu3 {
     std::size_t next;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) const -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_rotate {
@@ -177,7 +228,7 @@ namespace ud2::luogu3 {
     std::size_t next;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) const -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_bulk_move {
@@ -186,7 +237,7 @@ namespace ud2::luogu3 {
     std::size_t next;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) const -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_bulk_copy {
@@ -195,7 +246,7 @@ namespace ud2::luogu3 {
     std::size_t next;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) const -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_fill {
@@ -204,7 +255,7 @@ namespace ud2::luogu3 {
     std::size_t next;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) const -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_iota {
@@ -213,7 +264,7 @@ namespace ud2::luogu3 {
     std::size_t next;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) const -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_sum {
@@ -222,7 +273,7 @@ namespace ud2::luogu3 {
     std::size_t next;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) const -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_product {
@@ -231,7 +282,7 @@ namespace ud2::luogu3 {
     std::size_t next;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) const -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_bulk_add {
@@ -240,7 +291,7 @@ namespace ud2::luogu3 {
     std::size_t next;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) const -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_bulk_subtract {
@@ -249,7 +300,7 @@ namespace ud2::luogu3 {
     std::size_t next;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) const -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_bulk_multiply {
@@ -258,7 +309,7 @@ namespace ud2::luogu3 {
     std::size_t next;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) const -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_bulk_divide {
@@ -267,7 +318,7 @@ namespace ud2::luogu3 {
     std::size_t next;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) const -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_bulk_modulo {
@@ -276,7 +327,7 @@ namespace ud2::luogu3 {
     std::size_t next;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) const -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_vector_add {
@@ -286,7 +337,7 @@ namespace ud2::luogu3 {
     std::size_t next;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) const -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_vector_subtract {
@@ -296,7 +347,7 @@ namespace ud2::luogu3 {
     std::size_t next;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) const -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   struct state_vector_multiply {
@@ -306,7 +357,7 @@ namespace ud2::luogu3 {
     std::size_t next;
     auto max_stack() const -> std::size_t;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) const -> void;
+    auto emit_c(std::ostream& out, const emit_options& options, const emit_hints& hints) const -> void;
   };
 
   using state = std::variant<
@@ -344,12 +395,50 @@ namespace ud2::luogu3 {
     state_vector_subtract,
     state_vector_multiply>;
 
+  struct runtime_kernels {
+    bool sort = false;
+    bool multiply_scalar = false;
+    bool multiply_elementwise = false;
+    bool prefix_sum = false;
+    bool suffix_sum = false;
+    bool finite_difference = false;
+    bool sum = false;
+    bool product = false;
+    bool reverse = false;
+    bool rotate = false;
+    bool copy = false;
+  };
+
   struct program {
     std::vector<state> states = std::vector<state>(1);
     std::size_t init = 0;
     auto emit_source(std::ostream& out) const -> void;
-    auto emit_c(std::ostream& out) const -> void;
+    auto emit_c(std::ostream& out, const emit_options& options = {}) const -> void;
   };
+
+  // A program as four columns: the opcode (the index of the state type in
+  // state), up to three stacks in the order of their fields, the push value
+  // and up to two successors. emit_source writes the columns directly.
+  // emit_c builds each state with state_at and runs the emitter program
+  // uses: the C backend's closed forms, fusion and per-state code are
+  // written against the state types, and a second copy over the columns
+  // would have to be kept in step with every one of them.
+  struct packed_program {
+    static constexpr auto none = ~static_cast<std::uint32_t>(0);
+    std::vector<std::uint8_t> ops = std::vector<std::uint8_t>(1);
+    std::vector<std::array<std::uint8_t, 3>> stacks = std::vector<std::array<std::uint8_t, 3>>(1);
+    std::vector<std::uint32_t> vals = std::vector<std::uint32_t>(1);
+    std::vector<std::array<std::uint32_t, 2>> successors = std::vector<std::array<std::uint32_t, 2>>(1, {none, none});
+    std::uint32_t init = 0;
+    auto size() const -> std::size_t;
+    auto state_at(std::size_t i) const -> state;
+    auto emit_source(std::ostream& out) const -> void;
+    auto emit_c(std::ostream& out, const emit_options& options = {}) const -> void;
+  };
+
+  auto pack(const program& prog) -> packed_program;
+  auto unpack(const packed_program& packed) -> program;
+  auto emit_runtime(std::ostream& out, std::size_t capacity, const runtime_kernels& kernels) -> void;
 }
 
 #endif
@@ -1,12 +1,26 @@
+#include <algorithm>
 #include <argagg/argagg.hpp>
 #include <cerrno>
+#include <charconv>
 #include <config.h>
 #include <cstring>
+#include <fcntl.h>
 #include <fstream>
 #include <iostream>
-#include <iterator>
+#include <lsp/server.hpp>
+#include <optional>
+#include <luogu3/analysis.hpp>
 #include <luogu3/compile.hpp>
+#include <luogu3/passes.hpp>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#if HAVE_MMAP
+#include <sys/mman.h>
+#endif
 
 struct help_impl {
   const char* name;
@@ -14,21 +28,120 @@ struct help_impl {
 
   friend auto operator<<(std::ostream& out, help_impl s) -> std::ostream& {
     return out
-      << "Usage: " << s.name << " [options] <file>\n\nOptions:\n"
+      << "Usage: " << s.name << " [options] <file>\n"
+      << "       " << s.name << " --lsp\n\nOptions:\n"
       << s.arg_parser;
   };
 };
 
+template <class T>
+auto parse_number(const argagg::option_results& option, T fallback) -> std::optional<T> {
+  if (!option)
+    return fallback;
+  auto text = std::string_view{option.as<const char*>()};
+  auto val = T{};
+  auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), val);
+  if (ec != std::errc{} || end != text.data() + text.size())
+    return std::nullopt;
+  return val;
+}
+
+class source_file {
+  std::string buffer;
+  void* map = nullptr;
+  std::size_t map_size = 0;
+
+public:
+  std::string_view text;
+
+  source_file() = default;
+  source_file(const source_file&) = delete;
+  auto operator=(const source_file&) -> source_file& = delete;
+
+  ~source_file() {
+#if HAVE_MMAP
+    if (this->map)
+      munmap(this->map, this->map_size);
+#endif
+  }
+
+  auto open(const std::string& filename) -> bool {
+    auto is_std = filename == "-";
+    auto fd = is_std ? STDIN_FILENO : ::open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+      return false;
+    auto ok = this->load(fd);
+    if (!is_std)
+      close(fd);
+    return ok;
+  }
+
+private:
+  auto load(int fd) -> bool {
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+      return false;
+#if HAVE_MMAP
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+      auto size = static_cast<std::size_t>(st.st_size);
+      auto map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (map != MAP_FAILED) {
+        this->map = map;
+        this->map_size = size;
+        this->text = {static_cast<const char*>(map), size};
+        return true;
+      }
+    }
+#endif
+    auto block = static_cast<std::size_t>(st.st_blksize > 65536 ? st.st_blksize : 65536);
+    auto size = static_cast<std::size_t>(0);
+    for (;;) {
+      if (this->buffer.size() - size < block)
+        this->buffer.resize(std::max(this->buffer.size() * 2, size + block));
+      auto count = read(fd, this->buffer.data() + size, this->buffer.size() - size);
+      if (count == -1) {
+        if (errno == EINTR)
+          continue;
+        return false;
+      }
+      if (count == 0)
+        break;
+      size += static_cast<std::size_t>(count);
+    }
+    this->buffer.resize(size);
+    this->text = this->buffer;
+    return true;
+  }
+};
+
 auto main(int argc, char* argv[]) -> int {
   std::ios_base::sync_with_stdio(false);
   std::string filename;
   std::string output;
   bool format;
+  bool stats;
+  bool time_passes;
+  std::vector<const ud2::luogu3::pass*> pipeline;
+  ud2::luogu3::compile_options compile_options;
+  ud2::luogu3::emit_options emit_options;
   {
     auto arg_parser = argagg::parser{{
       {"version", {"-V", "--version"}, "show the version", 0},
       {"output", {"-o", "--output"}, "output file (default: -)", 1},
       {"format", {"-f", "--format"}, "format the code instead of compiling it", 0},
+      {"optimize", {"-O"}, "optimization level from 0 to 3 (default: 2); -O3 adds --fuse, --cache-top and --closed-forms where allowed", 1},
+      {"passes", {"--passes"}, "comma-separated list of passes to run instead of an optimization level", 1},
+      {"time-passes", {"--time-passes"}, "print the running time, state counts and peak memory growth of each pass to stderr", 0},
+      {"jobs", {"-j", "--jobs"}, "number of threads used for parsing, or 0 for one per core (default: 1)", 1},
+      {"max-states", {"--max-states"}, "maximum number of states in a program (default: 100000)", 1},
+      {"stack-capacity", {"--stack-capacity"}, "capacity of each stack in the emitted program (default: 1000000)", 1},
+      {"guard-pages", {"--guard-pages"}, "detect stack overflow and underflow with guard pages instead of checks (requires a stack capacity that is a multiple of 16384)", 0},
+      {"cache-top", {"--cache-top"}, "keep the top of each stack in a local variable (cannot be combined with --guard-pages)", 0},
+      {"closed-forms", {"--closed-forms"}, "evaluate counting loops with affine bodies in closed form", 0},
+      {"count-dispatches", {"--count-dispatches"}, "make the emitted program print the number of states it entered to stderr when it terminates", 0},
+      {"fuse", {"--fuse"}, "emit chains of states with a single predecessor as one block (cannot be combined with --guard-pages)", 0},
+      {"stats", {"--stats"}, "print optimization statistics to stderr", 0},
+      {"lsp", {"--lsp"}, "run a language server on stdin and stdout", 0},
       {"help", {"-h", "--help"}, "show this help message", 0},
     }};
     auto help = help_impl{*argv, arg_parser};
@@ -50,6 +163,72 @@ auto main(int argc, char* argv[]) -> int {
       std::cerr << PACKAGE_VERSION "\n";
       return 0;
     }
+    auto jobs = parse_number<std::size_t>(args["jobs"], 1);
+    auto max_states = parse_number<std::size_t>(args["max-states"], ud2::luogu3::max_states);
+    auto stack_capacity = parse_number<std::size_t>(args["stack-capacity"], ud2::luogu3::stack_capacity);
+    auto level = parse_number<int>(args["optimize"], ud2::luogu3::default_opt_level);
+    if (!jobs) {
+      std::cerr << "invalid number of jobs: " << args["jobs"].as<std::string>() << '\n';
+      return 2;
+    }
+    if (!max_states) {
+      std::cerr << "invalid maximum number of states: " << args["max-states"].as<std::string>() << '\n';
+      return 2;
+    }
+    if (!stack_capacity) {
+      std::cerr << "invalid stack capacity: " << args["stack-capacity"].as<std::string>() << '\n';
+      return 2;
+    }
+    if (!level) {
+      std::cerr << "invalid optimization level: " << args["optimize"].as<std::string>() << '\n';
+      return 2;
+    }
+    compile_options.jobs = *jobs;
+    compile_options.max_states = *max_states;
+    emit_options.stack_capacity = *stack_capacity;
+    if (!emit_options.stack_capacity) {
+      std::cerr << "stack capacity must be positive\n";
+      return 2;
+    }
+    emit_options.guard_pages = args["guard-pages"];
+    if (emit_options.guard_pages && emit_options.stack_capacity % ud2::luogu3::guard_granularity) {
+      std::cerr << "stack capacity must be a multiple of " << ud2::luogu3::guard_granularity << " with guard pages\n";
+      return 2;
+    }
+    emit_options.cache_top = args["cache-top"];
+    if (emit_options.guard_pages && emit_options.cache_top) {
+      std::cerr << "--cache-top cannot be combined with --guard-pages\n";
+      return 2;
+    }
+    emit_options.closed_forms = args["closed-forms"];
+    emit_options.count_dispatches = args["count-dispatches"];
+    try {
+      pipeline = args["passes"] ? ud2::luogu3::parse_pipeline(args["passes"].as<std::string>()) : ud2::luogu3::preset_pipeline(*level);
+    } catch (const std::invalid_argument& e) {
+      std::cerr << e.what() << '\n';
+      if (args["passes"]) {
+        std::cerr << "\nPasses:\n";
+        for (const auto& p : ud2::luogu3::registered_passes())
+          std::cerr << "    " << p.name << "\n        " << p.description << '\n';
+      }
+      return 2;
+    }
+    auto fuse = ud2::luogu3::find_pass("fuse");
+    if (args["fuse"] && std::find(pipeline.begin(), pipeline.end(), fuse) == pipeline.end())
+      pipeline.push_back(fuse);
+    if (emit_options.guard_pages && std::find(pipeline.begin(), pipeline.end(), fuse) != pipeline.end()) {
+      if (args["fuse"] || args["passes"]) {
+        std::cerr << "fusion cannot be combined with --guard-pages\n";
+        return 2;
+      }
+      pipeline.erase(std::find(pipeline.begin(), pipeline.end(), fuse));
+    }
+    if (*level >= ud2::luogu3::max_opt_level && !args["passes"]) {
+      emit_options.cache_top = !emit_options.guard_pages;
+      emit_options.closed_forms = true;
+    }
+    if (args["lsp"])
+      return ud2::luogu3::lsp::serve(std::cin, std::cout, compile_options);
     if (args.pos.size() < 1) {
       std::cerr << help;
       return 2;
@@ -57,24 +236,19 @@ auto main(int argc, char* argv[]) -> int {
     filename = args.pos[0];
     output = args["output"].as<std::string>("-");
     format = args["format"];
+    stats = args["stats"];
+    time_passes = args["time-passes"];
   }
-  errno = 0;
-  std::string source;
-  {
-    auto is_std = filename == "-";
-    auto in = is_std ? &std::cin : new std::ifstream{filename};
-    if (is_std)
-      filename = "<stdin>";
-    source.assign<std::istreambuf_iterator<char>>({*in}, {});
-    if (!is_std)
-      delete in;
-  }
-  if (errno) {
+  auto source = source_file{};
+  auto opened = source.open(filename);
+  if (filename == "-")
+    filename = "<stdin>";
+  if (!opened) {
     std::cerr << filename << ": " << std::strerror(errno) << '\n';
     return 1;
   }
-  auto result = ud2::luogu3::compile(source);
-  auto error = ud2::luogu3::print_diagnostics(std::cerr, result.diags, filename, source);
+  auto result = ud2::luogu3::compile(source.text, compile_options);
+  auto error = ud2::luogu3::print_diagnostics(std::cerr, result.diags, filename, source.text);
   errno = 0;
   {
     auto is_std = output == "-";
@@ -83,8 +257,33 @@ auto main(int argc, char* argv[]) -> int {
       output = "<stdout>";
     if (format)
       result.prog.emit_source(*out);
-    else
-      result.prog.emit_c(*out);
+    else {
+      auto state = ud2::luogu3::pass_state{result.prog, emit_options.stack_capacity};
+      auto reports = ud2::luogu3::run_pipeline(state, pipeline);
+      if (stats)
+        for (const auto& r : reports) {
+          std::cerr << r.p->stat << ": " << r.result.count;
+          if (r.result.total)
+            std::cerr << " of " << *r.result.total;
+          std::cerr << '\n';
+        }
+      if (time_passes) {
+        auto total = 0.0;
+        for (const auto& r : reports) {
+          std::cerr << r.p->name << ": " << (r.seconds * 1e3) << " ms, " << r.states_before << " -> " << r.states_after << " states";
+          if (r.peak_growth)
+            std::cerr << ", peak +" << *r.peak_growth << " KiB";
+          std::cerr << '\n';
+          total += r.seconds;
+        }
+        std::cerr << "total: " << (total * 1e3) << " ms\n";
+      }
+      emit_options.origin = state.origin;
+      emit_options.hints = state.hints;
+      emit_options.fused = state.fused;
+      emit_options.idioms = state.idioms;
+      result.prog.emit_c(*out, emit_options);
+    }
     if (!is_std)
       delete out;
   }